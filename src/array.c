@@ -1,24 +1,46 @@
 #include "array.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-// Gonna store the capacity of the array and it's currently "occupied" size in
-// the 4*2 bytes before the array, called a "header"
-#define ARRAY_RAW_DATA(array) ((int *)(array) - 2)       // Grab 2 int sized spots
-#define ARRAY_CAPACITY(array) (ARRAY_RAW_DATA(array)[0]) // store max capacity
-#define ARRAY_OCCUPIED(array) (ARRAY_RAW_DATA(array)[1]) // store used count
+// Gonna store the capacity of the array, it's currently "occupied" size, the size of an element,
+// its slot in the memory registry (-1 if it isn't in it) and what its memory is counted as in the
+// 8*4 bytes before the array, called a "header". 32 bytes keeps the data as aligned as malloc left
+// it, the last two ints are only there for that
+#define ARRAY_HEADER_INTS 8
+#define ARRAY_HEADER_SIZE (sizeof(int) * ARRAY_HEADER_INTS)
+#define ARRAY_RAW_DATA(array) ((int *)(array) - ARRAY_HEADER_INTS)
+#define ARRAY_CAPACITY(array) (ARRAY_RAW_DATA(array)[0])     // store max capacity
+#define ARRAY_OCCUPIED(array) (ARRAY_RAW_DATA(array)[1])     // store used count
+#define ARRAY_ELEMENT_SIZE(array) (ARRAY_RAW_DATA(array)[2]) // bytes per element
+#define ARRAY_SLOT(array) (ARRAY_RAW_DATA(array)[3])         // memory registry slot
+#define ARRAY_CATEGORY(array) (ARRAY_RAW_DATA(array)[4])     // memory_category_e
+#define ARRAY_ASSET(array) (ARRAY_RAW_DATA(array)[5])        // asset index or MEMORY_NO_ASSET
+
+// A whole alignment in front of aligned arrays leaves room for the header and the base pointer
+#define ARRAY_ALIGNED_FRONT (ARRAY_ALIGNMENT + sizeof(void *) + ARRAY_HEADER_SIZE)
+
+// Counted under the array's tag, untagged ones are other memory of no asset
+static void account(void *array, size_t front, bool freed) {
+    long long bytes = front + (long long)ARRAY_CAPACITY(array) * ARRAY_ELEMENT_SIZE(array);
+    memory_add(ARRAY_CATEGORY(array), ARRAY_ASSET(array), freed ? -bytes : bytes);
+}
 
 // returns a dynamically sized array... must remember to free, see "array_free"
 void *array_hold(void *array, int count, int element_size) {
-    int header_size = sizeof(int) * 2;
-
     if (array == NULL) {
-        int adjusted_size = header_size + count;
-        int *result = (int *)calloc(adjusted_size, element_size);
+        int *result = (int *)calloc(1, ARRAY_HEADER_SIZE + (size_t)count * element_size);
 
-        result[0] = count; // capacity
-        result[1] = count; // actual count
-        return result + 2;
+        result[0] = count;           // capacity
+        result[1] = count;           // actual count
+        result[2] = element_size;    // element size
+        result[3] = -1;              // not in the registry
+        result[4] = MEMORY_OTHER;    // untagged
+        result[5] = MEMORY_NO_ASSET; // untagged
+        account(result + ARRAY_HEADER_INTS, ARRAY_HEADER_SIZE, false);
+        return result + ARRAY_HEADER_INTS;
     } else if (ARRAY_OCCUPIED(array) + count <= ARRAY_CAPACITY(array)) {
         ARRAY_OCCUPIED(array) += count;
         return array;
@@ -28,13 +50,24 @@ void *array_hold(void *array, int count, int element_size) {
 
         // double the capacity, if not enough, allocate exactly the needed size
         int new_capacity = needed_size > double_capacity ? needed_size : double_capacity;
-        int adjusted_size = header_size + (new_capacity * element_size);
+        // size_t so big meshes don't overflow the byte count
+        size_t adjusted_size = ARRAY_HEADER_SIZE + ((size_t)new_capacity * element_size);
 
+        // Tagged arrays can be read by a report at any time, they only move under the lock
+        bool tracked = ARRAY_SLOT(array) >= 0;
+        account(array, ARRAY_HEADER_SIZE, true);
+        if (tracked)
+            memory_lock();
         int *result = (int *)realloc(ARRAY_RAW_DATA(array), adjusted_size);
         result[0] = new_capacity; // capacity
         result[1] = needed_size;  // new actual count
+        if (tracked) {
+            memory_retrack(result[3], result + ARRAY_HEADER_INTS);
+            memory_unlock();
+        }
+        account(result + ARRAY_HEADER_INTS, ARRAY_HEADER_SIZE, false);
 
-        return result + 2;
+        return result + ARRAY_HEADER_INTS;
     }
 }
 
@@ -44,14 +77,155 @@ int array_size(void *array) {
     return size;
 }
 
+int array_capacity(void *array) { return array != NULL ? ARRAY_CAPACITY(array) : 0; }
+
+int array_element_size(void *array) { return array != NULL ? ARRAY_ELEMENT_SIZE(array) : 0; }
+
+memory_category_e array_category(void *array) {
+    return array != NULL ? ARRAY_CATEGORY(array) : MEMORY_OTHER;
+}
+
+int array_asset(void *array) { return array != NULL ? ARRAY_ASSET(array) : MEMORY_NO_ASSET; }
+
+// Size only goes down here, so the registry sees the most a tagged array ever held
+static void shrink(void *array, int size) {
+    if (ARRAY_SLOT(array) >= 0)
+        memory_slot_shrink(ARRAY_SLOT(array), ARRAY_OCCUPIED(array));
+    ARRAY_OCCUPIED(array) = size;
+}
+
 void array_reset(void *array) {
     if (array != NULL)
-        ARRAY_OCCUPIED(array) = 0;
+        shrink(array, 0);
+}
+
+void array_truncate(void *array, int size) {
+    if (array != NULL && size < ARRAY_OCCUPIED(array))
+        shrink(array, size);
+}
+
+// Out of the registry before it goes, so a report never reads it freed
+static void untrack(void *array) {
+    if (ARRAY_SLOT(array) < 0)
+        return;
+    memory_lock();
+    memory_untrack(ARRAY_SLOT(array));
+    memory_unlock();
 }
 
 // Free the array and its "header"
 void array_free(void *array) {
-    if (array != NULL)
-        free(ARRAY_RAW_DATA(array));
-    array = NULL;
+    if (array == NULL)
+        return;
+    account(array, ARRAY_HEADER_SIZE, true);
+    untrack(array);
+    free(ARRAY_RAW_DATA(array));
+}
+
+// The allocation itself, kept right in front of the header since the data no longer starts there
+#define ARRAY_ALIGNED_BASE(array) (((void **)ARRAY_RAW_DATA(array))[-1])
+
+void *array_hold_aligned(void *array, int count, int element_size) {
+    if (array != NULL && ARRAY_OCCUPIED(array) + count <= ARRAY_CAPACITY(array)) {
+        ARRAY_OCCUPIED(array) += count;
+        return array;
+    }
+
+    int size = array_size(array);
+    int needed_size = size + count;
+    int double_capacity = array != NULL ? ARRAY_CAPACITY(array) * 2 : 0;
+    int new_capacity = needed_size > double_capacity ? needed_size : double_capacity;
+
+    // malloc can't promise more than 16 bytes of alignment and realloc would lose ours, so growing
+    // copies
+    char *base = calloc(ARRAY_ALIGNED_FRONT + (size_t)new_capacity * element_size, 1);
+    uintptr_t data = ((uintptr_t)base + ARRAY_ALIGNED_FRONT) & ~(uintptr_t)(ARRAY_ALIGNMENT - 1);
+    void *result = (void *)data;
+
+    ARRAY_CAPACITY(result) = new_capacity;
+    ARRAY_OCCUPIED(result) = needed_size;
+    ARRAY_ELEMENT_SIZE(result) = element_size;
+    ARRAY_SLOT(result) = array != NULL ? ARRAY_SLOT(array) : -1;
+    ARRAY_CATEGORY(result) = array != NULL ? ARRAY_CATEGORY(array) : MEMORY_OTHER;
+    ARRAY_ASSET(result) = array != NULL ? ARRAY_ASSET(array) : MEMORY_NO_ASSET;
+    ARRAY_ALIGNED_BASE(result) = base;
+    account(result, ARRAY_ALIGNED_FRONT, false);
+
+    if (array != NULL) {
+        memcpy(result, array, (size_t)size * element_size);
+        account(array, ARRAY_ALIGNED_FRONT, true);
+        if (ARRAY_SLOT(array) >= 0) {
+            memory_lock();
+            memory_retrack(ARRAY_SLOT(array), result);
+            memory_unlock();
+        }
+        free(ARRAY_ALIGNED_BASE(array));
+    }
+    return result;
+}
+
+void array_free_aligned(void *array) {
+    if (array == NULL)
+        return;
+    account(array, ARRAY_ALIGNED_FRONT, true);
+    untrack(array);
+    free(ARRAY_ALIGNED_BASE(array));
+}
+
+static void tag(void *array, size_t front, memory_category_e category, int asset) {
+    if (array == NULL)
+        return;
+
+    // Everything it holds so far moves over to the new tag
+    account(array, front, true);
+    memory_lock();
+    ARRAY_CATEGORY(array) = category;
+    ARRAY_ASSET(array) = asset;
+    // The registry is only for the wasted capacity report, the tag is counted either way
+    if (ARRAY_SLOT(array) < 0)
+        ARRAY_SLOT(array) = memory_track(array);
+    memory_unlock();
+    account(array, front, false);
+}
+
+void array_tag(void *array, memory_category_e category, int asset) {
+    tag(array, ARRAY_HEADER_SIZE, category, asset);
+}
+
+void array_tag_aligned(void *array, memory_category_e category, int asset) {
+    tag(array, ARRAY_ALIGNED_FRONT, category, asset);
+}
+
+void vec3_soa_hold(vec3_soa_t *soa, int count) {
+    soa->x = array_hold(soa->x, count, sizeof(float));
+    soa->y = array_hold(soa->y, count, sizeof(float));
+    soa->z = array_hold(soa->z, count, sizeof(float));
+}
+
+void vec3_soa_tag(vec3_soa_t *soa, memory_category_e category, int asset) {
+    array_tag(soa->x, category, asset);
+    array_tag(soa->y, category, asset);
+    array_tag(soa->z, category, asset);
+}
+
+void vec4_soa_hold(vec4_soa_t *soa, int count) {
+    soa->x = array_hold(soa->x, count, sizeof(float));
+    soa->y = array_hold(soa->y, count, sizeof(float));
+    soa->z = array_hold(soa->z, count, sizeof(float));
+    soa->w = array_hold(soa->w, count, sizeof(float));
+}
+
+void vec3_soa_free(vec3_soa_t *soa) {
+    array_free(soa->x);
+    array_free(soa->y);
+    array_free(soa->z);
+    *soa = (vec3_soa_t){0};
+}
+
+void vec4_soa_free(vec4_soa_t *soa) {
+    array_free(soa->x);
+    array_free(soa->y);
+    array_free(soa->z);
+    array_free(soa->w);
+    *soa = (vec4_soa_t){0};
 }
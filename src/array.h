@@ -4,7 +4,9 @@
 #include <stddef.h>
 
 #include "color.h"
+#include "memory.h"
 #include "triangle.h"
+#include "vector.h"
 
 // preprocessor function for fast push backs
 #define array_push(array, value)                                                                   \
@@ -15,9 +17,35 @@
 
 void *array_hold(void *array, int count, int element_size);
 void array_reset(void *array);
+// Drop everything past size, keeps the capacity
+void array_truncate(void *array, int size);
 int array_size(void *array);
+int array_capacity(void *array);
+int array_element_size(void *array);
 void array_free(void *array);
 
+// Counts the array's memory under category and asset from now on, growing included, instead of as
+// other memory. Does nothing to an array that was never held
+void array_tag(void *array, memory_category_e category, int asset);
+// What the array's memory is counted as, other memory of no asset if it was never tagged
+memory_category_e array_category(void *array);
+int array_asset(void *array);
+
+// Same as array_hold, but the first element starts a cache line, so elements sized to whole lines
+// never straddle one more than they have to. Everything but holding, freeing and tagging is shared,
+// only grow, free and tag these with the aligned versions
+#define ARRAY_ALIGNMENT 64
+void *array_hold_aligned(void *array, int count, int element_size);
+void array_free_aligned(void *array);
+void array_tag_aligned(void *array, memory_category_e category, int asset);
+
+// Structure of arrays, every component is its own dynamic array holding count more elements
+void vec3_soa_hold(vec3_soa_t *soa, int count);
+void vec4_soa_hold(vec4_soa_t *soa, int count);
+void vec3_soa_tag(vec3_soa_t *soa, memory_category_e category, int asset);
+void vec3_soa_free(vec3_soa_t *soa);
+void vec4_soa_free(vec4_soa_t *soa);
+
 #define dynarray(type)                                                                             \
     typedef struct {                                                                               \
         size_t capacity, occupied;                                                                 \
@@ -0,0 +1,333 @@
+#include "bvh.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "array.h"
+
+aabb_t aabb_empty(void) {
+    aabb_t box = {
+        .min = {FLT_MAX, FLT_MAX, FLT_MAX},
+        .max = {-FLT_MAX, -FLT_MAX, -FLT_MAX},
+    };
+    return box;
+}
+
+aabb_t aabb_union(aabb_t a, aabb_t b) {
+    aabb_t box = {
+        .min = {fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z)},
+        .max = {fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z)},
+    };
+    return box;
+}
+
+aabb_t aabb_add_point(aabb_t box, vec3_t point) {
+    aabb_t point_box = {point, point};
+    return aabb_union(box, point_box);
+}
+
+// Arvo's method, transform the center, the new half extents are the absolute matrix times the
+// old ones
+aabb_t aabb_transform(aabb_t box, const mat4_t *m) {
+    vec3_t center = vec3_mul(vec3_add(box.min, box.max), 0.5f);
+    vec3_t extent = vec3_mul(vec3_sub(box.max, box.min), 0.5f);
+
+    vec3_t new_center = vec4_to_vec3(mat4_mul_vec4(m, vec3_to_vec4(center)));
+    vec3_t new_extent = {
+        fabsf(m->m[0][0]) * extent.x + fabsf(m->m[0][1]) * extent.y + fabsf(m->m[0][2]) * extent.z,
+        fabsf(m->m[1][0]) * extent.x + fabsf(m->m[1][1]) * extent.y + fabsf(m->m[1][2]) * extent.z,
+        fabsf(m->m[2][0]) * extent.x + fabsf(m->m[2][1]) * extent.y + fabsf(m->m[2][2]) * extent.z,
+    };
+
+    aabb_t result = {vec3_sub(new_center, new_extent), vec3_add(new_center, new_extent)};
+    return result;
+}
+
+static float vec3_axis(vec3_t v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+static float aabb_centroid(aabb_t box, int axis) {
+    return (vec3_axis(box.min, axis) + vec3_axis(box.max, axis)) * 0.5f;
+}
+
+static bool aabb_contains(aabb_t box, vec3_t point) {
+    return point.x >= box.min.x && point.x <= box.max.x && point.y >= box.min.y &&
+           point.y <= box.max.y && point.z >= box.min.z && point.z <= box.max.z;
+}
+
+// Fills the node at index, children get reserved next to each other and filled after
+static void build_node(bvh_t *bvh, int index, int first, int count, int depth) {
+    aabb_t bounds = aabb_empty();
+    aabb_t centroid_bounds = aabb_empty();
+    for (int i = first; i < first + count; i++) {
+        aabb_t box = bvh->instance_bounds[bvh->instances[i]];
+        bounds = aabb_union(bounds, box);
+
+        vec3_t centroid = vec3_mul(vec3_add(box.min, box.max), 0.5f);
+        centroid_bounds = aabb_add_point(centroid_bounds, centroid);
+    }
+
+    bvh->nodes[index] = (bvh_node_t){.bounds = bounds, .left = -1, .first = first, .count = count};
+    if (count <= BVH_MAX_LEAF_SIZE)
+        return;
+
+    // Split the longest axis of the centroids down the middle
+    vec3_t size = vec3_sub(centroid_bounds.max, centroid_bounds.min);
+    int axis = size.x > size.y && size.x > size.z ? 0 : size.y > size.z ? 1 : 2;
+    float middle = aabb_centroid(centroid_bounds, axis);
+
+    int split = first;
+    for (int i = first; i < first + count; i++) {
+        if (aabb_centroid(bvh->instance_bounds[bvh->instances[i]], axis) < middle) {
+            int temp = bvh->instances[i];
+            bvh->instances[i] = bvh->instances[split];
+            bvh->instances[split] = temp;
+            split++;
+        }
+    }
+
+    // Everything on one side (stacked instances), or getting too deep, just halve the count so
+    // the tree stays within BVH_MAX_DEPTH
+    if (split == first || split == first + count || depth >= BVH_MAX_DEPTH / 2)
+        split = first + count / 2;
+
+    int left = array_size(bvh->nodes);
+    bvh->nodes = array_hold(bvh->nodes, 2, sizeof(bvh_node_t));
+    bvh->nodes[index].left = left;
+
+    build_node(bvh, left, first, split - first, depth + 1);
+    build_node(bvh, left + 1, split, first + count - split, depth + 1);
+}
+
+void bvh_build(bvh_t *bvh, aabb_t *instance_bounds) {
+    bvh->instance_bounds = instance_bounds;
+    array_reset(bvh->nodes);
+    array_reset(bvh->instances);
+
+    int num_instances = array_size(instance_bounds);
+    if (num_instances == 0)
+        return;
+
+    bvh->instances = array_hold(bvh->instances, num_instances, sizeof(int));
+    for (int i = 0; i < num_instances; i++) {
+        bvh->instances[i] = i;
+    }
+
+    bvh->nodes = array_hold(bvh->nodes, 1, sizeof(bvh_node_t));
+    build_node(bvh, 0, 0, num_instances, 0);
+}
+
+void bvh_refit(bvh_t *bvh) {
+    // Children always come after their parent, so walking backwards sees them first
+    for (int i = array_size(bvh->nodes) - 1; i >= 0; i--) {
+        bvh_node_t *node = &bvh->nodes[i];
+
+        if (node->left == -1) {
+            node->bounds = aabb_empty();
+            for (int j = node->first; j < node->first + node->count; j++) {
+                node->bounds = aabb_union(node->bounds, bvh->instance_bounds[bvh->instances[j]]);
+            }
+        } else {
+            node->bounds =
+                aabb_union(bvh->nodes[node->left].bounds, bvh->nodes[node->left + 1].bounds);
+        }
+    }
+}
+
+typedef enum { BOX_OUTSIDE, BOX_INTERSECTS, BOX_INSIDE } box_side_e;
+
+// Only the two corners furthest along and against the plane normal need testing
+static box_side_e classify_box(aabb_t box, const plane_t *plane) {
+    vec3_t n = plane->normal;
+    vec3_t furthest = {
+        n.x >= 0.0f ? box.max.x : box.min.x,
+        n.y >= 0.0f ? box.max.y : box.min.y,
+        n.z >= 0.0f ? box.max.z : box.min.z,
+    };
+    vec3_t nearest = {
+        n.x >= 0.0f ? box.min.x : box.max.x,
+        n.y >= 0.0f ? box.min.y : box.max.y,
+        n.z >= 0.0f ? box.min.z : box.max.z,
+    };
+
+    if (vec3_dot(vec3_sub(furthest, plane->point), n) < 0.0f)
+        return BOX_OUTSIDE;
+    if (vec3_dot(vec3_sub(nearest, plane->point), n) >= 0.0f)
+        return BOX_INSIDE;
+    return BOX_INTERSECTS;
+}
+
+// Clears the bits of planes the box is completely inside of, false if it is outside any of them
+static bool cull_box(aabb_t box, const plane_t *planes, int num_planes, unsigned *plane_mask) {
+    for (int p = 0; p < num_planes; p++) {
+        if (!(*plane_mask & (1u << p)))
+            continue;
+
+        box_side_e side = classify_box(box, &planes[p]);
+        if (side == BOX_OUTSIDE)
+            return false;
+        if (side == BOX_INSIDE)
+            *plane_mask &= ~(1u << p);
+    }
+    return true;
+}
+
+void bvh_cull_frustum(const bvh_t *bvh, const plane_t *planes, int num_planes, int **visible) {
+    if (array_size(bvh->nodes) == 0)
+        return;
+
+    // Each entry remembers which planes its parent was not already fully inside of
+    struct {
+        int node;
+        unsigned plane_mask;
+    } stack[BVH_MAX_DEPTH * 2];
+    int stack_size = 0;
+
+    stack[stack_size].node = 0;
+    stack[stack_size].plane_mask = (1u << num_planes) - 1;
+    stack_size++;
+
+    while (stack_size > 0) {
+        stack_size--;
+        const bvh_node_t *node = &bvh->nodes[stack[stack_size].node];
+        unsigned plane_mask = stack[stack_size].plane_mask;
+
+        if (!cull_box(node->bounds, planes, num_planes, &plane_mask))
+            continue;
+
+        // Completely inside, take the whole subtree without testing anything below
+        if (plane_mask == 0) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                array_push(*visible, bvh->instances[i]);
+            }
+            continue;
+        }
+
+        if (node->left == -1) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                unsigned instance_mask = plane_mask;
+                int instance = bvh->instances[i];
+                if (cull_box(bvh->instance_bounds[instance], planes, num_planes, &instance_mask))
+                    array_push(*visible, instance);
+            }
+            continue;
+        }
+
+        stack[stack_size].node = node->left;
+        stack[stack_size].plane_mask = plane_mask;
+        stack_size++;
+        stack[stack_size].node = node->left + 1;
+        stack[stack_size].plane_mask = plane_mask;
+        stack_size++;
+    }
+}
+
+void bvh_query_point(const bvh_t *bvh, vec3_t point, int **results) {
+    if (array_size(bvh->nodes) == 0)
+        return;
+
+    int stack[BVH_MAX_DEPTH * 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const bvh_node_t *node = &bvh->nodes[stack[--stack_size]];
+        if (!aabb_contains(node->bounds, point))
+            continue;
+
+        if (node->left == -1) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                int instance = bvh->instances[i];
+                if (aabb_contains(bvh->instance_bounds[instance], point))
+                    array_push(*results, instance);
+            }
+        } else {
+            stack[stack_size++] = node->left;
+            stack[stack_size++] = node->left + 1;
+        }
+    }
+}
+
+// Slab test, t_enter is where the ray gets into the box (0 if it starts inside)
+static bool ray_hits_box(aabb_t box, vec3_t origin, vec3_t inv_direction, float t_max,
+                         float *t_enter) {
+    float tx1 = (box.min.x - origin.x) * inv_direction.x;
+    float tx2 = (box.max.x - origin.x) * inv_direction.x;
+    float ty1 = (box.min.y - origin.y) * inv_direction.y;
+    float ty2 = (box.max.y - origin.y) * inv_direction.y;
+    float tz1 = (box.min.z - origin.z) * inv_direction.z;
+    float tz2 = (box.max.z - origin.z) * inv_direction.z;
+
+    // fminf/fmaxf drop the NaNs from 0 * inf on axis aligned rays
+    float t_near = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)), fmaxf(fminf(tz1, tz2), 0.0f));
+    float t_far = fminf(fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2)), fmaxf(tz1, tz2));
+
+    *t_enter = t_near;
+    return t_near <= t_far && t_near < t_max;
+}
+
+int bvh_raycast(const bvh_t *bvh, vec3_t origin, vec3_t direction, bvh_hit_fn hit, void *data,
+                float *t) {
+    if (array_size(bvh->nodes) == 0)
+        return -1;
+
+    vec3_t inv_direction = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+    float closest = INFINITY;
+    int closest_instance = -1;
+
+    int stack[BVH_MAX_DEPTH * 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const bvh_node_t *node = &bvh->nodes[stack[--stack_size]];
+
+        float t_enter;
+        if (!ray_hits_box(node->bounds, origin, inv_direction, closest, &t_enter))
+            continue;
+
+        if (node->left == -1) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                int instance = bvh->instances[i];
+                if (!ray_hits_box(bvh->instance_bounds[instance], origin, inv_direction, closest,
+                                  &t_enter))
+                    continue;
+
+                float t_hit = hit ? hit(data, instance, origin, direction, closest) : t_enter;
+                if (t_hit < closest) {
+                    closest = t_hit;
+                    closest_instance = instance;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so it can shrink closest before the other is tested
+        float t_left, t_right;
+        bool left_hit = ray_hits_box(bvh->nodes[node->left].bounds, origin, inv_direction,
+                                     closest, &t_left);
+        bool right_hit = ray_hits_box(bvh->nodes[node->left + 1].bounds, origin, inv_direction,
+                                      closest, &t_right);
+        if (left_hit && right_hit && t_left <= t_right) {
+            stack[stack_size++] = node->left + 1;
+            stack[stack_size++] = node->left;
+        } else if (left_hit && right_hit) {
+            stack[stack_size++] = node->left;
+            stack[stack_size++] = node->left + 1;
+        } else if (left_hit) {
+            stack[stack_size++] = node->left;
+        } else if (right_hit) {
+            stack[stack_size++] = node->left + 1;
+        }
+    }
+
+    if (closest_instance != -1)
+        *t = closest;
+    return closest_instance;
+}
+
+void bvh_free(bvh_t *bvh) {
+    array_free(bvh->nodes);
+    array_free(bvh->instances);
+    memset(bvh, 0, sizeof(bvh_t));
+}
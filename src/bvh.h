@@ -0,0 +1,63 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdbool.h>
+
+#include "clip.h"
+#include "matrix.h"
+#include "vector.h"
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 64
+
+typedef struct {
+    vec3_t min, max;
+} aabb_t;
+
+// Internal nodes have their children at left and left + 1, leaves have left == -1 and own
+// instances[first, first + count)
+typedef struct {
+    aabb_t bounds;
+    int left;
+    int first, count;
+} bvh_node_t;
+
+// Bounding volume hierarchy over instances, instance ids are whatever the caller indexes
+// instance_bounds with, the scene uses mesh indices
+typedef struct {
+    bvh_node_t *nodes;       // dynamic array, root at 0, children always after their parent
+    int *instances;          // dynamic array of instance ids in leaf order
+    aabb_t *instance_bounds; // dynamic array, world bounds of every instance, owned by the caller
+} bvh_t;
+
+// Returns t of the closest hit on the instance that is below t_max, or INFINITY
+typedef float (*bvh_hit_fn)(void *data, int instance, vec3_t origin, vec3_t direction,
+                            float t_max);
+
+aabb_t aabb_empty(void);
+aabb_t aabb_union(aabb_t a, aabb_t b);
+aabb_t aabb_add_point(aabb_t box, vec3_t point);
+// Bounds of the box after an affine transform, still axis aligned so usually bigger
+aabb_t aabb_transform(aabb_t box, const mat4_t *m);
+
+// Top down build over every instance in instance_bounds
+void bvh_build(bvh_t *bvh, aabb_t *instance_bounds);
+
+// Instances moved, keep the tree and just recompute the bounds bottom up
+void bvh_refit(bvh_t *bvh);
+
+// Appends every instance whose bounds touch the inside of all planes to visible, whole subtrees
+// are rejected or accepted without visiting their leaves
+void bvh_cull_frustum(const bvh_t *bvh, const plane_t *planes, int num_planes, int **visible);
+
+// Appends every instance whose bounds contain point to results
+void bvh_query_point(const bvh_t *bvh, vec3_t point, int **results);
+
+// Closest hit along the ray, returns the instance or -1, hit refines each candidate (NULL just
+// uses the bounds), t is written on a hit
+int bvh_raycast(const bvh_t *bvh, vec3_t origin, vec3_t direction, bvh_hit_fn hit, void *data,
+                float *t);
+
+void bvh_free(bvh_t *bvh);
+
+#endif
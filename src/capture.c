@@ -0,0 +1,180 @@
+#include "capture.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "array.h"
+#include "loader.h"
+
+// Start of the file, the size of a record catches captures from a build with a different layout
+typedef struct {
+    char magic[8];
+    int32_t version;
+    int32_t setup_size;
+    int32_t render_mode;
+    int32_t span_length;
+    int32_t bilinear_filter;
+    int32_t width, height;
+    int32_t num_meshes;
+} capture_header_t;
+
+// Before the triangles of every mesh
+typedef struct {
+    char texture_file_name[SCENE_FILE_MAX_PATH];
+    int32_t texture_address;
+    int32_t texture_format;
+    int32_t num_triangles;
+} capture_mesh_header_t;
+
+static const char capture_magic[8] = "SRCAPTR";
+
+bool capture_write(const scene_t *scene, const char *file_name) {
+    FILE *file = fopen(file_name, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening capture file %s\n", file_name);
+        return false;
+    }
+
+    int num_visible = array_size(scene->visible_meshes);
+    capture_header_t header = {
+        .version = CAPTURE_VERSION,
+        .setup_size = sizeof(triangle_setup_t),
+        .render_mode = get_render_mode(),
+        .span_length = texture_span_length(),
+        .bilinear_filter = should_filter_bilinear(),
+        .num_meshes = num_visible,
+    };
+    memcpy(header.magic, capture_magic, sizeof(header.magic));
+    int width, height;
+    get_window_size(&width, &height);
+    header.width = width;
+    header.height = height;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (int v = 0; v < num_visible && written; v++) {
+        const mesh_t *mesh = &scene->meshes[scene->visible_meshes[v]];
+
+        capture_mesh_header_t mesh_header = {
+            .texture_address = scene->models[mesh->model].texture.address,
+            .texture_format = scene->models[mesh->model].texture.format,
+            .num_triangles = array_size(mesh->raster_tris),
+        };
+        strncpy(mesh_header.texture_file_name,
+                loader_texture_file_name(&scene->loader, mesh->model),
+                sizeof(mesh_header.texture_file_name) - 1);
+
+        written = fwrite(&mesh_header, sizeof(mesh_header), 1, file) == 1;
+        if (written && mesh_header.num_triangles > 0) {
+            written = fwrite(mesh->raster_tris, sizeof(triangle_setup_t),
+                             mesh_header.num_triangles,
+                             file) == (size_t)mesh_header.num_triangles;
+        }
+    }
+
+    if (fclose(file) != 0 || !written) {
+        fprintf(stderr, "Error writing capture file %s\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+bool capture_read(capture_t *capture, const char *file_name) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening capture file %s\n", file_name);
+        return false;
+    }
+
+    capture_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, capture_magic, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Error reading capture file %s, not a capture\n", file_name);
+        fclose(file);
+        return false;
+    }
+    if (header.version != CAPTURE_VERSION || header.setup_size != sizeof(triangle_setup_t)) {
+        fprintf(stderr, "Error reading capture file %s, written by another version\n", file_name);
+        fclose(file);
+        return false;
+    }
+
+    capture->render_mode = header.render_mode;
+    capture->span_length = header.span_length;
+    capture->bilinear_filter = header.bilinear_filter;
+    capture->width = header.width;
+    capture->height = header.height;
+
+    bool read = true;
+    for (int m = 0; m < header.num_meshes && read; m++) {
+        capture_mesh_header_t mesh_header;
+        read = fread(&mesh_header, sizeof(mesh_header), 1, file) == 1 &&
+               mesh_header.num_triangles >= 0;
+        if (!read)
+            break;
+
+        capture_mesh_t mesh = {
+            .texture = -1,
+            .texture_address = mesh_header.texture_address,
+            .texture_format = mesh_header.texture_format,
+        };
+        memcpy(mesh.texture_file_name, mesh_header.texture_file_name,
+               sizeof(mesh.texture_file_name));
+        mesh.texture_file_name[sizeof(mesh.texture_file_name) - 1] = '\0';
+
+        if (mesh_header.num_triangles > 0) {
+            mesh.triangles = array_hold_aligned(mesh.triangles, mesh_header.num_triangles,
+                                                sizeof(triangle_setup_t));
+            read = fread(mesh.triangles, sizeof(triangle_setup_t), mesh_header.num_triangles,
+                         file) == (size_t)mesh_header.num_triangles;
+        }
+        // Pushed even when cut short, so capture_free still gets the triangles
+        array_push(capture->meshes, mesh);
+    }
+    fclose(file);
+
+    if (!read) {
+        fprintf(stderr, "Error reading capture file %s, cut short\n", file_name);
+        capture_free(capture);
+        return false;
+    }
+
+    // Meshes of the same model share one texture, the same as in the scene, read the same way
+    int num_meshes = array_size(capture->meshes);
+    for (int m = 0; m < num_meshes; m++) {
+        capture_mesh_t *mesh = &capture->meshes[m];
+        if (mesh->texture_file_name[0] == '\0')
+            continue;
+
+        for (int other = 0; other < m && mesh->texture < 0; other++) {
+            const capture_mesh_t *seen = &capture->meshes[other];
+            if (strcmp(seen->texture_file_name, mesh->texture_file_name) == 0 &&
+                seen->texture_address == mesh->texture_address &&
+                seen->texture_format == mesh->texture_format)
+                mesh->texture = seen->texture;
+        }
+        if (mesh->texture >= 0)
+            continue;
+
+        texture_t texture = {.address = mesh->texture_address, .format = mesh->texture_format};
+        load_png_texture_data(&texture, mesh->texture_file_name);
+        mesh->texture = array_size(capture->textures);
+        array_push(capture->textures, texture);
+    }
+    return true;
+}
+
+void capture_free(capture_t *capture) {
+    int num_meshes = array_size(capture->meshes);
+    for (int m = 0; m < num_meshes; m++) {
+        array_free_aligned(capture->meshes[m].triangles);
+    }
+    int num_textures = array_size(capture->textures);
+    for (int t = 0; t < num_textures; t++) {
+        texture_free(&capture->textures[t]);
+    }
+    array_free(capture->meshes);
+    array_free(capture->textures);
+
+    memset(capture, 0, sizeof(capture_t));
+}
@@ -0,0 +1,47 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+
+#include "display.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "texture.h"
+#include "triangle.h"
+
+#define CAPTURE_FILE_NAME "./capture.bin"
+#define CAPTURE_VERSION 3
+
+// One visible mesh of a captured frame, exactly as update left it for render
+typedef struct {
+    char texture_file_name[SCENE_FILE_MAX_PATH]; // empty if the model has no texture
+    // How the texture is read and stored, meshes only share a texture if both are the same
+    texture_address_e texture_address;
+    texture_format_e texture_format;
+    int texture;                 // index into the capture's textures, -1 if it has none
+    triangle_setup_t *triangles; // aligned dynamic array, in drawing order
+} capture_mesh_t;
+
+// Everything the rasterizer reads in a frame, so it can be run again without the scene, the
+// camera or anything before it
+typedef struct {
+    render_mode_e render_mode;
+    int span_length;
+    bool bilinear_filter;
+    int width, height;      // window the triangles were set up for
+    capture_mesh_t *meshes; // dynamic array
+    texture_t *textures;    // dynamic array, one per file name, only filled by capture_read
+} capture_t;
+
+// Writes the triangles of every visible mesh from the last update, along with the settings that
+// change how they are drawn. Same machine only, the records are written as they are in memory.
+// Returns false if the file could not be written
+bool capture_write(const scene_t *scene, const char *file_name);
+
+// Reads a capture and decodes every texture it names once. Returns false if the file could not be
+// read or was written by another version
+bool capture_read(capture_t *capture, const char *file_name);
+
+void capture_free(capture_t *capture);
+
+#endif
@@ -38,6 +38,10 @@ static float lerp_float(float a, float b, float lerp_factor) {
 }
 
 static void clip_against_plane(polygon_t *polygon, const plane_t *frust_plane) {
+    // Already completely outside an earlier plane
+    if (polygon->num_vertices == 0)
+        return;
+
     vec3_t plane_point = frust_plane->point;
     vec3_t plane_norm = frust_plane->normal;
 
@@ -116,3 +120,67 @@ int polygon_to_tris(const polygon_t *polygon, triangle_t triangles[MAX_NUM_POLY_
 
     return num_triangles;
 }
+
+// Cohen-Sutherland region codes
+enum {
+    OUT_LEFT = 1 << 0,
+    OUT_RIGHT = 1 << 1,
+    OUT_TOP = 1 << 2,
+    OUT_BOTTOM = 1 << 3,
+};
+
+static int region_code(float x, float y, float x_min, float y_min, float x_max, float y_max) {
+    int code = 0;
+    if (x < x_min)
+        code |= OUT_LEFT;
+    else if (x > x_max)
+        code |= OUT_RIGHT;
+    if (y < y_min)
+        code |= OUT_TOP;
+    else if (y > y_max)
+        code |= OUT_BOTTOM;
+    return code;
+}
+
+bool clip_line_to_rect(float *x0, float *y0, float *x1, float *y1, float x_min, float y_min,
+                       float x_max, float y_max) {
+    int code0 = region_code(*x0, *y0, x_min, y_min, x_max, y_max);
+    int code1 = region_code(*x1, *y1, x_min, y_min, x_max, y_max);
+
+    while (true) {
+        // Both inside, trivially accept
+        if (!(code0 | code1))
+            return true;
+
+        // Both share an outside region, trivially reject
+        if (code0 & code1)
+            return false;
+
+        // Move the outside point onto the edge of the region it is in
+        int code_out = code0 ? code0 : code1;
+        float x, y;
+        if (code_out & OUT_TOP) {
+            x = *x0 + (*x1 - *x0) * (y_min - *y0) / (*y1 - *y0);
+            y = y_min;
+        } else if (code_out & OUT_BOTTOM) {
+            x = *x0 + (*x1 - *x0) * (y_max - *y0) / (*y1 - *y0);
+            y = y_max;
+        } else if (code_out & OUT_RIGHT) {
+            y = *y0 + (*y1 - *y0) * (x_max - *x0) / (*x1 - *x0);
+            x = x_max;
+        } else {
+            y = *y0 + (*y1 - *y0) * (x_min - *x0) / (*x1 - *x0);
+            x = x_min;
+        }
+
+        if (code_out == code0) {
+            *x0 = x;
+            *y0 = y;
+            code0 = region_code(x, y, x_min, y_min, x_max, y_max);
+        } else {
+            *x1 = x;
+            *y1 = y;
+            code1 = region_code(x, y, x_min, y_min, x_max, y_max);
+        }
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef CLIPPING_H
 #define CLIPPING_H
 
+#include <stdbool.h>
+
 #include "triangle.h"
 #include "vector.h"
 
@@ -37,4 +39,9 @@ void clip_polygon_to_planes(const plane_t planes[NUM_PLANES], polygon_t *polygon
 // Returns number of triangles created, outputs triangles into array
 int polygon_to_tris(const polygon_t *polygon, triangle_t triangles[MAX_NUM_POLY_TRIS]);
 
+// Cohen-Sutherland, clips the segment in place to the inclusive rectangle, returns false if the
+// segment lies entirely outside
+bool clip_line_to_rect(float *x0, float *y0, float *x1, float *y1, float x_min, float y_min,
+                       float x_max, float y_max);
+
 #endif
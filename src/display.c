@@ -1,20 +1,46 @@
 #include "display.h"
 
 #include <SDL2/SDL_video.h>
+#include <limits.h>
 #include <stdio.h>
 
+#include "clip.h"
+#include "memory.h"
+
 #define PIXEL_SCALING_FACTOR 2
 
+// Once this much of the last frame changed, uploading just the dirty part saves less than drawing
+// straight into the texture does
+#define LOCK_MIN_DIRTY_FRACTION 0.5f
+
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static int window_width = 1280;
 static int window_height = 720;
 
-static color_t *color_buffer = NULL;
+static color_t *color_buffer = NULL;       // what gets drawn into this frame, one of the two below
+static color_t *owned_color_buffer = NULL; // ours, uploaded with SDL_UpdateTexture
+static color_t *locked_pixels = NULL;      // the texture's own memory while it is locked
+static bool lock_supported = true;         // false once a lock came back with a padded pitch
 static float *w_buffer = NULL;
 static SDL_Texture *color_buffer_texture = NULL;
+
+// Boxes around everything drawn on top of the background, empty when x_min > x_max
+typedef struct {
+    int x_min, y_min, x_max, y_max;
+} dirty_rect_t;
+
+// Marking grows it with plain min and max
+#define EMPTY_RECT {.x_min = INT_MAX, .y_min = INT_MAX, .x_max = INT_MIN, .y_max = INT_MIN}
+
+static const dirty_rect_t empty_rect = EMPTY_RECT;
+static dirty_rect_t frame_dirty = EMPTY_RECT;
+static dirty_rect_t previous_dirty = EMPTY_RECT;
+static bool texture_valid = false; // the texture holds the whole of the last frame
 static render_mode_e render_mode = RENDER_WIRE_FRAME;
 static cull_mode_e cull_mode = CULL_BACKFACE;
+static int texture_span = TEXTURE_SPAN_LONG;
+static bool bilinear_filter = false;
 
 // initialize all SDL components for drawing on screen.
 bool window_init(void) {
@@ -47,7 +73,8 @@ bool window_init(void) {
     }
 
     // Memory for color buffer
-    color_buffer = (color_t *)malloc(sizeof(color_t) * window_width * window_height);
+    owned_color_buffer = (color_t *)malloc(sizeof(color_t) * window_width * window_height);
+    color_buffer = owned_color_buffer;
     if (!color_buffer) {
         fprintf(stderr, "Error creating color buffer.\n");
         return false;
@@ -63,11 +90,16 @@ bool window_init(void) {
     // SDL texture for rendering buffer from memory
     color_buffer_texture = SDL_CreateTexture(
         renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, window_width, window_height);
-    if (!color_buffer) {
+    if (!color_buffer_texture) {
         fprintf(stderr, "Error creating color buffer texture.\n");
         return false;
     }
 
+    // Ours plus the texture it is shown through, which SDL keeps a copy of
+    long long num_pixels = (long long)window_width * window_height;
+    memory_add(MEMORY_COLOR_BUFFER, MEMORY_NO_ASSET, 2 * num_pixels * sizeof(color_t));
+    memory_add(MEMORY_DEPTH_BUFFER, MEMORY_NO_ASSET, num_pixels * sizeof(float));
+
     return true;
 }
 
@@ -95,6 +127,7 @@ void draw_pixel(int x, int y, color_t color) {
     color_buffer[(window_width * y) + x] = color;
 }
 
+// Part of the background like the clear, so never dirty
 void draw_grid(color_t color) {
     for (int y = 0; y < window_height; y += 10) {
         for (int x = 0; x < window_width; x += 10) {
@@ -103,43 +136,103 @@ void draw_grid(color_t color) {
     }
 }
 
-// Naive "DDA" implementation
-void draw_line(int x0, int y0, int x1, int y1, color_t color) {
-    int delta_x = x1 - x0;
-    int delta_y = y1 - y0;
-
-    // Only works when longest "side-length" is the one by which you travel the entire length,
-    // comment out ternary to see what it looks like without... gaps in steep lines
-    int side_length = abs(delta_x) >= abs(delta_y) ? abs(delta_x) : abs(delta_y);
-
-    // Per step increase
-    float x_inc = delta_x / (float)side_length; // either one or the slope
-    float y_inc = delta_y / (float)side_length; // same as above
-
-    float current_x = x0;
-    float current_y = y0;
-    for (int i = 0; i <= side_length; i++) {
-        draw_pixel(roundf(current_x), roundf(current_y), color);
-        current_x += x_inc;
-        current_y += y_inc;
+void mark_dirty_rect(int x_min, int y_min, int x_max, int y_max) {
+    if (x_min > x_max || y_min > y_max)
+        return;
+
+    frame_dirty.x_min = x_min < frame_dirty.x_min ? x_min : frame_dirty.x_min;
+    frame_dirty.y_min = y_min < frame_dirty.y_min ? y_min : frame_dirty.y_min;
+    frame_dirty.x_max = x_max > frame_dirty.x_max ? x_max : frame_dirty.x_max;
+    frame_dirty.y_max = y_max > frame_dirty.y_max ? y_max : frame_dirty.y_max;
+}
+
+static bool rect_is_empty(dirty_rect_t rect) {
+    return rect.x_min > rect.x_max || rect.y_min > rect.y_max;
+}
+
+static dirty_rect_t rect_union(dirty_rect_t a, dirty_rect_t b) {
+    if (rect_is_empty(a))
+        return b;
+    if (rect_is_empty(b))
+        return a;
+
+    dirty_rect_t result = {
+        .x_min = a.x_min < b.x_min ? a.x_min : b.x_min,
+        .y_min = a.y_min < b.y_min ? a.y_min : b.y_min,
+        .x_max = a.x_max > b.x_max ? a.x_max : b.x_max,
+        .y_max = a.y_max > b.y_max ? a.y_max : b.y_max,
+    };
+    return result;
+}
+
+// Clamped to the window, draws are clipped so anything outside never reached the buffer anyway
+static dirty_rect_t rect_clamp(dirty_rect_t rect) {
+    rect.x_min = rect.x_min < 0 ? 0 : rect.x_min;
+    rect.y_min = rect.y_min < 0 ? 0 : rect.y_min;
+    rect.x_max = rect.x_max > window_width - 1 ? window_width - 1 : rect.x_max;
+    rect.y_max = rect.y_max > window_height - 1 ? window_height - 1 : rect.y_max;
+    return rect;
+}
+
+// Bresenham, integer only, endpoints must already be inside the viewport so no per-pixel checks
+void draw_clipped_line(int x0, int y0, int x1, int y1, color_t color) {
+    int delta_x = abs(x1 - x0);
+    int delta_y = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? window_width : -window_width;
+
+    mark_dirty_rect(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, x0 > x1 ? x0 : x1, y0 > y1 ? y0 : y1);
+
+    color_t *pixel = &color_buffer[(window_width * y0) + x0];
+    color_t *last = &color_buffer[(window_width * y1) + x1];
+
+    // error term tracks distance from the ideal line for both axes at once
+    int error = delta_x + delta_y;
+    while (true) {
+        *pixel = color;
+        if (pixel == last)
+            break;
+
+        int error_2 = 2 * error;
+        if (error_2 >= delta_y) {
+            error += delta_y;
+            pixel += step_x;
+        }
+        if (error_2 <= delta_x) {
+            error += delta_x;
+            pixel += step_y;
+        }
     }
 }
 
+void draw_line(int x0, int y0, int x1, int y1, color_t color) {
+    float fx0 = x0, fy0 = y0, fx1 = x1, fy1 = y1;
+
+    // clip once up front instead of bounds checking every pixel
+    if (!clip_line_to_rect(&fx0, &fy0, &fx1, &fy1, 0.0f, 0.0f, window_width - 1,
+                           window_height - 1))
+        return;
+
+    draw_clipped_line(roundf(fx0), roundf(fy0), roundf(fx1), roundf(fy1), color);
+}
+
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, color_t color) {
     draw_line(x0, y0, x1, y1, color);
     draw_line(x1, y1, x2, y2, color);
     draw_line(x2, y2, x0, y0, color);
 }
 
-// Solid
+// Solid, clipped to the viewport
 void draw_rectangle(int xpos, int ypos, int width, int height, color_t color) {
-    if (xpos + width >= window_width || ypos + height >= window_height)
-        return;
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            // adjust by offset
-            draw_pixel(x + xpos, y + ypos, color);
+    int x_start = xpos < 0 ? 0 : xpos;
+    int y_start = ypos < 0 ? 0 : ypos;
+    int x_end = xpos + width > window_width ? window_width : xpos + width;
+    int y_end = ypos + height > window_height ? window_height : ypos + height;
+    mark_dirty_rect(x_start, y_start, x_end - 1, y_end - 1);
+
+    for (int y = y_start; y < y_end; y++) {
+        for (int x = x_start; x < x_end; x++) {
+            color_buffer[(window_width * y) + x] = color;
         }
     }
 }
@@ -157,16 +250,81 @@ void update_w_buffer(int x, int y, float new_value) {
     w_buffer[(y * window_width) + x] = new_value;
 }
 
+void begin_color_buffer(void) {
+    frame_dirty = empty_rect;
+    color_buffer = owned_color_buffer;
+
+    // Big changes are drawn straight into the texture, which skips our copy entirely. Its old
+    // contents are undefined once locked, fine as every frame is drawn in full
+    int dirty_area = 0;
+    if (!rect_is_empty(previous_dirty))
+        dirty_area = (previous_dirty.x_max - previous_dirty.x_min + 1) *
+                     (previous_dirty.y_max - previous_dirty.y_min + 1);
+    bool mostly_dirty = dirty_area >= LOCK_MIN_DIRTY_FRACTION * window_width * window_height;
+    if (!lock_supported || (texture_valid && !mostly_dirty))
+        return;
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(color_buffer_texture, NULL, &pixels, &pitch) != 0)
+        return;
+
+    // Everything draws assuming rows are exactly window_width apart
+    if (pitch != window_width * (int)sizeof(color_t)) {
+        SDL_UnlockTexture(color_buffer_texture);
+        lock_supported = false;
+        return;
+    }
+
+    locked_pixels = pixels;
+    color_buffer = locked_pixels;
+}
+
 void render_color_buffer(void) {
-    SDL_UpdateTexture(color_buffer_texture, NULL, color_buffer, window_width * sizeof(color_t));
+    if (locked_pixels != NULL) {
+        SDL_UnlockTexture(color_buffer_texture);
+        locked_pixels = NULL;
+        texture_valid = true;
+    } else {
+        // Whatever changed since the texture was last written, the old drawing had to be erased
+        // and the new one added. Outside of both it is background in either frame
+        dirty_rect_t upload =
+            texture_valid ? rect_clamp(rect_union(frame_dirty, previous_dirty))
+                          : (dirty_rect_t){0, 0, window_width - 1, window_height - 1};
+
+        if (!rect_is_empty(upload)) {
+            SDL_Rect rect = {upload.x_min, upload.y_min, upload.x_max - upload.x_min + 1,
+                             upload.y_max - upload.y_min + 1};
+            SDL_UpdateTexture(color_buffer_texture, &rect,
+                              &color_buffer[(window_width * upload.y_min) + upload.x_min],
+                              window_width * sizeof(color_t));
+        }
+        texture_valid = true;
+    }
+    previous_dirty = rect_clamp(frame_dirty);
+
+    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+void render_previous_frame(void) {
     SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
     SDL_RenderPresent(renderer);
 }
 
 void set_render_mode(render_mode_e mode) { render_mode = mode; }
+render_mode_e get_render_mode(void) { return render_mode; }
 
 void switch_cull_mode() { cull_mode = cull_mode == CULL_BACKFACE ? CULL_NONE : CULL_BACKFACE; }
 
+void switch_texture_span_length() {
+    texture_span = texture_span == TEXTURE_SPAN_LONG ? TEXTURE_SPAN_SHORT : TEXTURE_SPAN_LONG;
+}
+int texture_span_length() { return texture_span; }
+
+void switch_texture_filter() { bilinear_filter = !bilinear_filter; }
+bool should_filter_bilinear() { return bilinear_filter; }
+
 bool should_cull_bface() { return cull_mode == CULL_BACKFACE; }
 bool should_render_wire() {
     return (render_mode == RENDER_WIRE_FRAME || render_mode == RENDER_WIRE_VERTS ||
@@ -176,14 +334,26 @@ bool should_render_fill() {
     return (render_mode == RENDER_FILL_WIRE || render_mode == RENDER_FILL);
 }
 bool should_render_verts() { return (render_mode == RENDER_WIRE_VERTS); }
+bool should_render_tris() {
+    return (should_render_fill() || should_render_texture() || should_render_ps1() ||
+            should_render_span_texture() || should_render_visibility());
+}
 bool should_render_texture() {
     return (render_mode == RENDER_TEXTURE || render_mode == RENDER_TEXTURE_WIRE);
 }
 bool should_render_ps1() { return (render_mode == RENDER_TEXTURE_PS1); }
+bool should_render_span_texture() { return (render_mode == RENDER_TEXTURE_SPAN); }
+bool should_render_visibility() { return (render_mode == RENDER_TEXTURE_VISIBILITY); }
 
 // Free all window related resources
 void window_free(void) {
-    free(color_buffer);
+    if (color_buffer_texture != NULL) {
+        long long num_pixels = (long long)window_width * window_height;
+        memory_add(MEMORY_COLOR_BUFFER, MEMORY_NO_ASSET,
+                   -2 * num_pixels * (long long)sizeof(color_t));
+        memory_add(MEMORY_DEPTH_BUFFER, MEMORY_NO_ASSET, -num_pixels * (long long)sizeof(float));
+    }
+    free(owned_color_buffer);
     free(w_buffer);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -10,6 +10,10 @@
 #define SECOND 1000.0f
 #define FRAME_TARGET_TIME (SECOND / FPS)
 
+// Pixels between exact perspective divides in the span textured mode
+#define TEXTURE_SPAN_SHORT 8
+#define TEXTURE_SPAN_LONG 16
+
 // NOTE: might be better to switch this over to a bit mask
 typedef enum {
     RENDER_WIRE_FRAME,
@@ -18,7 +22,9 @@ typedef enum {
     RENDER_FILL_WIRE,
     RENDER_TEXTURE,
     RENDER_TEXTURE_WIRE,
-    RENDER_TEXTURE_PS1
+    RENDER_TEXTURE_PS1,
+    RENDER_TEXTURE_SPAN,
+    RENDER_TEXTURE_VISIBILITY
 } render_mode_e;
 
 typedef enum { CULL_BACKFACE, CULL_NONE } cull_mode_e;
@@ -32,25 +38,50 @@ void window_free(void);
 
 void draw_pixel(int x, int y, color_t color);
 void draw_line(int x0, int y0, int x1, int y1, color_t color);
+// endpoints must already be inside the viewport, see clip_line_to_rect
+void draw_clipped_line(int x0, int y0, int x1, int y1, color_t color);
+// Part of the background along with clear_color_buffer, neither counts as drawing
 void draw_grid(color_t color);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, color_t color);
 void draw_rectangle(int xpos, int ypos, int width, int height, color_t color);
 
+// Only the part of the frame that changed gets uploaded, so everything drawn on top of the
+// background has to be inside a marked rectangle. The line and rectangle functions mark their
+// own, draw_pixel is per pixel so callers mark whole primitives instead
+void mark_dirty_rect(int x_min, int y_min, int x_max, int y_max);
+
 float w_buffer_at(int x, int y);
 void update_w_buffer(int x, int y, float w);
 
 void set_render_mode(render_mode_e mode);
+render_mode_e get_render_mode(void);
 void switch_cull_mode();
+// between TEXTURE_SPAN_SHORT and TEXTURE_SPAN_LONG
+void switch_texture_span_length();
+int texture_span_length();
+// Textures blended between their four nearest texels instead of the nearest one
+void switch_texture_filter();
+bool should_filter_bilinear();
 
 bool should_cull_bface();
 bool should_render_wire();
 bool should_render_fill();
 bool should_render_verts();
+// any mode that needs rasterized triangles, wire only modes just draw edges
+bool should_render_tris();
 bool should_render_texture();
 bool should_render_ps1();
+bool should_render_span_texture();
+bool should_render_visibility();
 
-// draw color buffer to SDL texture, show the texture
+// Start of a frame, before anything is drawn. Draws straight into the locked texture when most of
+// the last frame changed and the pitch allows, otherwise into our own buffer
+void begin_color_buffer(void);
+// draw color buffer to SDL texture, show the texture. Only the dirty part of our own buffer is
+// copied, a locked texture is just unlocked
 void render_color_buffer(void);
+// Show the last frame again, when nothing on screen could have changed
+void render_previous_frame(void);
 
 void clear_color_buffer(color_t color);
 void clear_w_buffer(void);
@@ -1,5 +1,10 @@
 #include "light.h"
 
+#include <math.h>
+#include <string.h>
+
+#include "array.h"
+
 static float clamp_light_factor(float light_factor, float min, float max) {
     const float result = light_factor < min ? min : light_factor;
     return result > max ? max : result;
@@ -17,3 +22,179 @@ color_t light_apply_intensity(color_t original_color, float percentage_factor) {
 
     return color;
 }
+
+local_light_t local_light_make(vec3_t position, vec3_t direction, float range, float intensity,
+                               float cone_angle) {
+    local_light_t light = {
+        .position = position,
+        .range = range,
+        .intensity = intensity,
+        .cos_outer = -1.0f,
+        .cos_inner = -1.0f,
+    };
+
+    if (cone_angle > 0.0f) {
+        vec3_normalize(&direction);
+        light.direction = direction;
+        light.cos_outer = cosf(cone_angle);
+        light.cos_inner = cosf(cone_angle * (1.0f - LIGHT_SPOT_SOFT_EDGE));
+    }
+    return light;
+}
+
+static bool sphere_in_frustum(const plane_t frustum[NUM_PLANES], vec3_t center, float radius) {
+    for (int p = 0; p < NUM_PLANES; p++) {
+        // Normals point in
+        if (vec3_dot(vec3_sub(center, frustum[p].point), frustum[p].normal) < -radius)
+            return false;
+    }
+    return true;
+}
+
+static int clamp_tile(float pixel, int num_tiles) {
+    int tile = (int)floorf(pixel / LIGHT_TILE_SIZE);
+    return tile < 0 ? 0 : tile >= num_tiles ? num_tiles - 1 : tile;
+}
+
+// First and last tile in x then y covered by a view space sphere. Projects the box around it,
+// dividing each side by whichever depth pushes it further out, so the rectangle is never too small
+static void sphere_tiles(const light_grid_t *grid, vec3_t center, float radius, float z_near,
+                         int tiles[4]) {
+    // Reaches behind the near plane, where the projection flips, so it could be anywhere
+    float z_min = center.z - radius;
+    float z_max = center.z + radius;
+    if (z_min <= z_near) {
+        tiles[0] = 0;
+        tiles[1] = grid->tiles_x - 1;
+        tiles[2] = 0;
+        tiles[3] = grid->tiles_y - 1;
+        return;
+    }
+
+    float left = center.x - radius, right = center.x + radius;
+    float bottom = center.y - radius, top = center.y + radius;
+    left /= left < 0.0f ? z_min : z_max;
+    right /= right > 0.0f ? z_min : z_max;
+    bottom /= bottom < 0.0f ? z_min : z_max;
+    top /= top > 0.0f ? z_min : z_max;
+
+    // Screen y goes down
+    float half_width = grid->width / 2.0f, half_height = grid->height / 2.0f;
+    tiles[0] = clamp_tile(half_width + left * grid->scale_x, grid->tiles_x);
+    tiles[1] = clamp_tile(half_width + right * grid->scale_x, grid->tiles_x);
+    tiles[2] = clamp_tile(half_height - top * grid->scale_y, grid->tiles_y);
+    tiles[3] = clamp_tile(half_height - bottom * grid->scale_y, grid->tiles_y);
+}
+
+void light_grid_build(light_grid_t *grid, const local_light_t *lights, const mat4_t *view_matrix,
+                      const mat4_t *projection_matrix, const plane_t frustum[NUM_PLANES],
+                      int width, int height) {
+    grid->width = width;
+    grid->height = height;
+    grid->tiles_x = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    grid->tiles_y = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    grid->scale_x = projection_matrix->m[0][0] * (width / 2.0f);
+    grid->scale_y = projection_matrix->m[1][1] * (height / 2.0f);
+
+    array_reset(grid->view_lights);
+    array_reset(grid->light_tiles);
+    array_reset(grid->tile_lights);
+    array_reset(grid->tile_offsets);
+
+    int num_tiles = grid->tiles_x * grid->tiles_y;
+    grid->tile_offsets = array_hold(grid->tile_offsets, num_tiles + 1, sizeof(int));
+    memset(grid->tile_offsets, 0, (num_tiles + 1) * sizeof(int));
+
+    // Culled and to view space, counting how many lights each tile gets
+    float z_near = frustum[NEAR_FRUSTUM].point.z;
+    int num_lights = array_size((void *)lights);
+    for (int i = 0; i < num_lights; i++) {
+        local_light_t light = lights[i];
+        vec4_t position = mat4_mul_vec4(view_matrix, vec3_to_vec4(light.position));
+        light.position = vec4_to_vec3(position);
+        if (!sphere_in_frustum(frustum, light.position, light.range))
+            continue;
+
+        // No translation for directions
+        vec4_t direction = {light.direction.x, light.direction.y, light.direction.z, 0.0f};
+        light.direction = vec4_to_vec3(mat4_mul_vec4(view_matrix, direction));
+        array_push(grid->view_lights, light);
+
+        int tiles[4];
+        sphere_tiles(grid, light.position, light.range, z_near, tiles);
+        for (int j = 0; j < 4; j++) {
+            array_push(grid->light_tiles, tiles[j]);
+        }
+        for (int y = tiles[2]; y <= tiles[3]; y++) {
+            for (int x = tiles[0]; x <= tiles[1]; x++) {
+                grid->tile_offsets[y * grid->tiles_x + x]++;
+            }
+        }
+    }
+
+    // Each offset to the end of its tile, then filled back to front so it ends on the start
+    for (int t = 1; t <= num_tiles; t++) {
+        grid->tile_offsets[t] += grid->tile_offsets[t - 1];
+    }
+    grid->tile_lights = array_hold(grid->tile_lights, grid->tile_offsets[num_tiles], sizeof(int));
+
+    // Back to front keeps every tile's lights in order
+    for (int i = array_size(grid->view_lights) - 1; i >= 0; i--) {
+        const int *tiles = &grid->light_tiles[i * 4];
+        for (int y = tiles[2]; y <= tiles[3]; y++) {
+            for (int x = tiles[0]; x <= tiles[1]; x++) {
+                grid->tile_lights[--grid->tile_offsets[y * grid->tiles_x + x]] = i;
+            }
+        }
+    }
+}
+
+float light_grid_shade(const light_grid_t *grid, vec3_t point, vec3_t normal) {
+    if (array_size(grid->view_lights) == 0 || point.z <= 0.0f)
+        return 0.0f;
+
+    // Same projection as the tiles were binned with
+    int tile_x = clamp_tile(grid->width / 2.0f + point.x / point.z * grid->scale_x, grid->tiles_x);
+    int tile_y =
+        clamp_tile(grid->height / 2.0f - point.y / point.z * grid->scale_y, grid->tiles_y);
+    int tile = tile_y * grid->tiles_x + tile_x;
+
+    float total = 0.0f;
+    for (int l = grid->tile_offsets[tile]; l < grid->tile_offsets[tile + 1]; l++) {
+        const local_light_t *light = &grid->view_lights[grid->tile_lights[l]];
+
+        vec3_t to_light = vec3_sub(light->position, point);
+        float distance = vec3_length(to_light);
+        if (distance >= light->range || distance == 0.0f)
+            continue;
+        to_light = vec3_div(to_light, distance);
+
+        float alignment = vec3_dot(normal, to_light);
+        if (alignment <= 0.0f)
+            continue;
+
+        // Spots fade out over the edge of their cone
+        float cone = 1.0f;
+        if (light->cos_outer > -1.0f) {
+            float cos_angle = -vec3_dot(light->direction, to_light);
+            if (cos_angle <= light->cos_outer)
+                continue;
+            if (cos_angle < light->cos_inner)
+                cone = (cos_angle - light->cos_outer) / (light->cos_inner - light->cos_outer);
+        }
+
+        // Smooth all the way down to nothing at range
+        float falloff = 1.0f - (distance * distance) / (light->range * light->range);
+        total += light->intensity * alignment * falloff * falloff * cone;
+    }
+    return total;
+}
+
+void light_grid_free(light_grid_t *grid) {
+    array_free(grid->view_lights);
+    array_free(grid->tile_offsets);
+    array_free(grid->tile_lights);
+    array_free(grid->light_tiles);
+
+    memset(grid, 0, sizeof(light_grid_t));
+}
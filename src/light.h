@@ -3,13 +3,56 @@
 
 #include <stdint.h>
 
+#include "clip.h"
 #include "display.h"
+#include "matrix.h"
 #include "vector.h"
 
+#define LIGHT_TILE_SIZE 32         // pixels along each side of a screen tile
+#define LIGHT_SPOT_SOFT_EDGE 0.2f  // share of a spot's cone angle, at its edge, that fades out
+
 typedef struct {
     vec3_t direction;
 } light_t;
 
+// Points light everything around them, spots only inside their cone. Neither reaches past range
+typedef struct {
+    vec3_t position;
+    vec3_t direction; // spots only, normalized
+    float range;
+    float intensity; // what a face right at the light and turned to it gets
+    float cos_outer; // cosine of the cone's half angle, -1 for points so nothing is outside it
+    float cos_inner; // fully lit inside this cosine, fading out to cos_outer
+} local_light_t;
+
+// Every visible local light in view space, and which of them reach each screen tile. Built once
+// per frame, so shading only looks at the few lights that can reach where it is
+typedef struct {
+    local_light_t *view_lights; // dynamic array, the lights that touch the frustum
+    int *tile_offsets;          // dynamic array, where each tile's lights start, then where all end
+    int *tile_lights;           // dynamic array, indices into view_lights, tile after tile
+    int *light_tiles;           // dynamic array, first and last tile x then y of each light
+    int tiles_x, tiles_y;
+    float scale_x, scale_y; // projection to pixels, the same the geometry stage uses
+    int width, height;
+} light_grid_t;
+
 color_t light_apply_intensity(color_t original_color, float percentage_factor);
 
+// Point light when cone_angle is 0 or less, otherwise a spot with that half angle in radians
+local_light_t local_light_make(vec3_t position, vec3_t direction, float range, float intensity,
+                               float cone_angle);
+
+// Moves the lights to view space, drops the ones wholly outside the frustum and bins the rest by
+// the tiles their bounding sphere covers on screen
+void light_grid_build(light_grid_t *grid, const local_light_t *lights, const mat4_t *view_matrix,
+                      const mat4_t *projection_matrix, const plane_t frustum[NUM_PLANES],
+                      int width, int height);
+
+// Summed light from every local light reaching a view space point with a normalized normal,
+// only the lights of the tile the point lands in are looked at
+float light_grid_shade(const light_grid_t *grid, vec3_t point, vec3_t normal);
+
+void light_grid_free(light_grid_t *grid);
+
 #endif
@@ -0,0 +1,142 @@
+#include "loader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "array.h"
+#include "memory.h"
+
+// Parts write to separate fields of the model, so they never need to wait on each other
+static void load_part(load_job_t *job, load_part_e part) {
+    switch (part) {
+    case LOAD_GEOMETRY:
+        job->loaded = model_load_geometry(&job->model, job->files.obj_file_name);
+        if (!job->loaded)
+            fprintf(stderr, "Error loading model %s\n", job->files.name);
+        break;
+    case LOAD_TEXTURE:
+        job->model.texture.address = job->files.address;
+        job->model.texture.format = job->files.format;
+        load_png_texture_data(&job->model.texture, job->files.png_file_name);
+        if (texture_loaded(&job->model.texture))
+            memory_add(MEMORY_TEXTURES, job->model.asset, texture_bytes(&job->model.texture));
+        break;
+    default:
+        break;
+    }
+}
+
+static int load_worker(void *data) {
+    loader_t *loader = data;
+    int num_tasks = array_size(loader->jobs) * NUM_LOAD_PARTS;
+
+    for (;;) {
+        if (SDL_AtomicGet(&loader->cancelled))
+            break;
+
+        int task = SDL_AtomicAdd(&loader->next_task, 1);
+        if (task >= num_tasks)
+            break;
+
+        int job_index = task / NUM_LOAD_PARTS;
+        load_job_t *job = &loader->jobs[job_index];
+        load_part(job, task % NUM_LOAD_PARTS);
+
+        // Returns the value before, other parts are still going unless this one was the last
+        if (SDL_AtomicAdd(&job->parts_left, -1) != 1)
+            continue;
+
+        SDL_LockMutex(loader->mutex);
+        array_push(loader->finished, job_index);
+        SDL_UnlockMutex(loader->mutex);
+    }
+
+    return 0;
+}
+
+void loader_start(loader_t *loader, const scene_file_model_t *models) {
+    int num_models = array_size((void *)models);
+    loader->num_remaining = num_models;
+    if (num_models == 0)
+        return;
+
+    loader->jobs = array_hold(loader->jobs, num_models, sizeof(load_job_t));
+    for (int i = 0; i < num_models; i++) {
+        loader->jobs[i] = (load_job_t){.files = models[i], .model = {.asset = i}};
+        SDL_AtomicSet(&loader->jobs[i].parts_left, NUM_LOAD_PARTS);
+    }
+    SDL_AtomicSet(&loader->next_task, 0);
+    SDL_AtomicSet(&loader->cancelled, 0);
+    loader->mutex = SDL_CreateMutex();
+
+    // Leave a core for the render thread, big obj files split themselves across more anyway
+    int num_threads = SDL_GetCPUCount() - 1;
+    if (num_threads > LOADER_MAX_THREADS)
+        num_threads = LOADER_MAX_THREADS;
+    if (num_threads > num_models * NUM_LOAD_PARTS)
+        num_threads = num_models * NUM_LOAD_PARTS;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    for (int i = 0; i < num_threads; i++) {
+        SDL_Thread *thread = SDL_CreateThread(load_worker, "loader", loader);
+        if (thread != NULL)
+            loader->threads[loader->num_threads++] = thread;
+    }
+
+    // Couldn't get any thread, still better to load everything up front than nothing at all
+    if (loader->num_threads == 0) {
+        fprintf(stderr, "Error creating loader threads, loading on the main thread\n");
+        load_worker(loader);
+    }
+}
+
+void loader_poll(loader_t *loader, int **finished) {
+    if (loader->mutex == NULL)
+        return;
+
+    SDL_LockMutex(loader->mutex);
+    int num_finished = array_size(loader->finished);
+    for (int i = 0; i < num_finished; i++) {
+        array_push(*finished, loader->finished[i]);
+    }
+    array_reset(loader->finished);
+    SDL_UnlockMutex(loader->mutex);
+
+    loader->num_remaining -= num_finished;
+}
+
+bool loader_done(const loader_t *loader) { return loader->num_remaining == 0; }
+
+const char *loader_texture_file_name(const loader_t *loader, int job) {
+    if (job < 0 || job >= array_size(loader->jobs))
+        return "";
+    return loader->jobs[job].files.png_file_name;
+}
+
+const char *loader_model_name(const loader_t *loader, int job) {
+    if (job < 0 || job >= array_size(loader->jobs))
+        return "";
+    return loader->jobs[job].files.name;
+}
+
+void loader_free(loader_t *loader) {
+    SDL_AtomicSet(&loader->cancelled, 1);
+    for (int i = 0; i < loader->num_threads; i++) {
+        SDL_WaitThread(loader->threads[i], NULL);
+    }
+
+    // Models handed out were taken out of their job, the rest failed, were never polled, or were
+    // cancelled half way
+    int num_jobs = array_size(loader->jobs);
+    for (int i = 0; i < num_jobs; i++) {
+        model_free(&loader->jobs[i].model);
+    }
+
+    if (loader->mutex != NULL)
+        SDL_DestroyMutex(loader->mutex);
+    array_free(loader->jobs);
+    array_free(loader->finished);
+
+    memset(loader, 0, sizeof(loader_t));
+}
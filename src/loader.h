@@ -0,0 +1,59 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "mesh.h"
+#include "scene_file.h"
+
+#define LOADER_MAX_THREADS 8
+
+// Every model is loaded in parts that run as separate tasks, so one model's texture decodes while
+// its geometry is simplified, and every texture in a scene decodes at the same time as the others
+typedef enum {
+    LOAD_GEOMETRY,
+    LOAD_TEXTURE,
+    NUM_LOAD_PARTS,
+} load_part_e;
+
+typedef struct {
+    scene_file_model_t files;
+    model_t model;           // only touched by the workers loading it until it is finished
+    SDL_atomic_t parts_left; // the worker finishing the last part reports the model
+    bool loaded;             // false if the obj could not be read
+} load_job_t;
+
+// Loads models on background threads, finished ones are collected by the render thread whenever
+// it is ready for them, so loading never stalls a frame
+typedef struct {
+    load_job_t *jobs;       // dynamic array, one per model, never resized while loading
+    SDL_atomic_t next_task; // job * NUM_LOAD_PARTS + part
+    SDL_atomic_t cancelled;
+    SDL_mutex *mutex;
+    int *finished; // dynamic array, jobs done since the last poll, guarded by mutex
+    int num_remaining;
+    SDL_Thread *threads[LOADER_MAX_THREADS];
+    int num_threads;
+} loader_t;
+
+// Queues one job per model and starts the workers, returns straight away
+void loader_start(loader_t *loader, const scene_file_model_t *models);
+
+// Appends the jobs that finished since the last call to finished, never blocks on a worker for
+// longer than it takes to swap a list. The caller takes ownership of the models of those jobs
+void loader_poll(loader_t *loader, int **finished);
+
+// True once every job has been handed out by loader_poll
+bool loader_done(const loader_t *loader);
+
+// Png the model of a job is textured from, jobs are in scene file order. Empty if there is none
+const char *loader_texture_file_name(const loader_t *loader, int job);
+
+// Name the scene file gave the model of a job
+const char *loader_model_name(const loader_t *loader, int job);
+
+// Stops handing out tasks, waits for the ones in flight and frees every model not handed out
+void loader_free(loader_t *loader);
+
+#endif
@@ -0,0 +1,477 @@
+#include "lod.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+// Symmetric 4x4 error matrix of summed planes, only the upper triangle is stored, doubles since
+// the terms get big and the costs are compared against each other
+typedef struct {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} quadric_t;
+
+// Half edge collapse, from is removed and its faces move over to to
+typedef struct {
+    int a, b; // a < b while deduplicating
+    int from, to;
+    double cost;
+} collapse_t;
+
+static quadric_t quadric_from_plane(double a, double b, double c, double d, double weight) {
+    quadric_t q = {
+        a * a * weight, a * b * weight, a * c * weight, a * d * weight, b * b * weight,
+        b * c * weight, b * d * weight, c * c * weight, c * d * weight, d * d * weight,
+    };
+    return q;
+}
+
+static void quadric_add(quadric_t *q, const quadric_t *r) {
+    q->a2 += r->a2;
+    q->ab += r->ab;
+    q->ac += r->ac;
+    q->ad += r->ad;
+    q->b2 += r->b2;
+    q->bc += r->bc;
+    q->bd += r->bd;
+    q->c2 += r->c2;
+    q->cd += r->cd;
+    q->d2 += r->d2;
+}
+
+// Sum of squared distances of p to every plane in the quadric
+static double quadric_error(const quadric_t *q, vec3_t p) {
+    double x = p.x, y = p.y, z = p.z;
+    return q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x +
+           q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y + q->c2 * z * z +
+           2.0 * q->cd * z + q->d2;
+}
+
+static bool tex_equal(tex2_t a, tex2_t b) { return a.u == b.u && a.v == b.v; }
+
+static int face_corner(const face_t *face, int vertex) {
+    return face->a == vertex ? 0 : face->b == vertex ? 1 : face->c == vertex ? 2 : -1;
+}
+
+static tex2_t *corner_uv(face_t *face, int corner) {
+    return corner == 0 ? &face->a_uv : corner == 1 ? &face->b_uv : &face->c_uv;
+}
+
+static int *corner_index(face_t *face, int corner) {
+    return corner == 0 ? &face->a : corner == 1 ? &face->b : &face->c;
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const collapse_t *edge_a = a;
+    const collapse_t *edge_b = b;
+    if (edge_a->a != edge_b->a)
+        return edge_a->a - edge_b->a;
+    return edge_a->b - edge_b->b;
+}
+
+static int compare_costs(const void *a, const void *b) {
+    double cost_a = ((const collapse_t *)a)->cost;
+    double cost_b = ((const collapse_t *)b)->cost;
+    return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+// Every edge of the live faces (all of them when dead is NULL) sorted by a then b, shared edges
+// show up once per face
+static int sorted_edges(const face_t *faces, const uint8_t *dead, int num_faces,
+                        collapse_t *edges) {
+    int num_edges = 0;
+    for (int i = 0; i < num_faces; i++) {
+        if (dead && dead[i])
+            continue;
+
+        int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+        for (int j = 0; j < 3; j++) {
+            int a = corners[j], b = corners[(j + 1) % 3];
+            edges[num_edges].a = a < b ? a : b;
+            edges[num_edges].b = a < b ? b : a;
+            num_edges++;
+        }
+    }
+    qsort(edges, num_edges, sizeof(collapse_t), compare_edges);
+    return num_edges;
+}
+
+// Unique edges of the live faces, returns how many
+static int collect_edges(const face_t *faces, const uint8_t *dead, int num_faces,
+                         collapse_t *edges) {
+    int num_edges = sorted_edges(faces, dead, num_faces, edges);
+
+    int num_unique = 0;
+    for (int i = 0; i < num_edges; i++) {
+        if (num_unique > 0 && edges[i].a == edges[num_unique - 1].a &&
+            edges[i].b == edges[num_unique - 1].b)
+            continue;
+        edges[num_unique++] = edges[i];
+    }
+    return num_unique;
+}
+
+// Vertices on an open border or a non-manifold edge are never removed, collapsing them would pull
+// the outline of the mesh in
+static bool lock_vertices(const face_t *faces, const uint8_t *dead, int num_faces,
+                          uint8_t *locked) {
+    // Every edge with its duplicates, anything not shared by exactly two faces is a border
+    collapse_t *edges = malloc(sizeof(collapse_t) * 3 * num_faces);
+    if (edges == NULL)
+        return false;
+    int num_edges = sorted_edges(faces, dead, num_faces, edges);
+
+    for (int i = 0; i < num_edges;) {
+        int count = 1;
+        while (i + count < num_edges && edges[i + count].a == edges[i].a &&
+               edges[i + count].b == edges[i].b)
+            count++;
+
+        if (count != 2) {
+            locked[edges[i].a] = 1;
+            locked[edges[i].b] = 1;
+        }
+        i += count;
+    }
+    free(edges);
+    return true;
+}
+
+typedef struct {
+    vec3_t position;
+    int index;
+} weld_t;
+
+static int compare_positions(const void *a, const void *b) {
+    const weld_t *weld_a = a;
+    const weld_t *weld_b = b;
+    if (weld_a->position.x != weld_b->position.x)
+        return weld_a->position.x < weld_b->position.x ? -1 : 1;
+    if (weld_a->position.y != weld_b->position.y)
+        return weld_a->position.y < weld_b->position.y ? -1 : 1;
+    if (weld_a->position.z != weld_b->position.z)
+        return weld_a->position.z < weld_b->position.z ? -1 : 1;
+    return weld_a->index - weld_b->index;
+}
+
+// Exporters split vertices along uv seams, faces carry their own uvs here so the copies can share
+// one index, otherwise every seam would look like an open border and never simplify
+static bool weld_vertices(const vec3_t *vertices, int num_vertices, int *welded) {
+    weld_t *sorted = malloc(sizeof(weld_t) * (num_vertices > 0 ? num_vertices : 1));
+    if (sorted == NULL)
+        return false;
+    for (int i = 0; i < num_vertices; i++) {
+        sorted[i].position = vertices[i];
+        sorted[i].index = i;
+    }
+    qsort(sorted, num_vertices, sizeof(weld_t), compare_positions);
+
+    // lowest index of each run of equal positions
+    for (int i = 0; i < num_vertices; i++) {
+        bool same = i > 0 && sorted[i].position.x == sorted[i - 1].position.x &&
+                    sorted[i].position.y == sorted[i - 1].position.y &&
+                    sorted[i].position.z == sorted[i - 1].position.z;
+        welded[sorted[i].index] = same ? welded[sorted[i - 1].index] : sorted[i].index;
+    }
+    free(sorted);
+    return true;
+}
+
+// Moving from onto to must not turn any of the faces that survive the collapse over
+static bool collapse_keeps_orientation(const vec3_t *vertices, const face_t *faces,
+                                       const uint8_t *dead, const int *adjacent, int num_adjacent,
+                                       int from, int to) {
+    for (int i = 0; i < num_adjacent; i++) {
+        int f = adjacent[i];
+        if (dead[f] || face_corner(&faces[f], to) != -1)
+            continue;
+
+        vec3_t points[3] = {vertices[faces[f].a], vertices[faces[f].b], vertices[faces[f].c]};
+        vec3_t before = triangle_normal(points);
+        points[face_corner(&faces[f], from)] = vertices[to];
+        vec3_t after = triangle_normal(points);
+
+        if (vec3_dot(before, after) <= 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// An interior edge may only collapse if its ends share exactly the two vertices opposite it,
+// otherwise the collapse pinches the surface and leaves doubled faces behind
+static bool collapse_keeps_manifold(const face_t *faces, const uint8_t *dead,
+                                    const int *adjacent_offsets, const int *adjacent, int from,
+                                    int to, int *stamps, int stamp) {
+    for (int i = adjacent_offsets[from]; i < adjacent_offsets[from + 1]; i++) {
+        const face_t *face = &faces[adjacent[i]];
+        if (!dead[adjacent[i]])
+            stamps[face->a] = stamps[face->b] = stamps[face->c] = stamp;
+    }
+
+    int num_shared = 0;
+    for (int i = adjacent_offsets[to]; i < adjacent_offsets[to + 1]; i++) {
+        const face_t *face = &faces[adjacent[i]];
+        if (dead[adjacent[i]])
+            continue;
+
+        int corners[3] = {face->a, face->b, face->c};
+        for (int j = 0; j < 3; j++) {
+            if (corners[j] != from && corners[j] != to && stamps[corners[j]] == stamp) {
+                // counted once, faces around to see every neighbour twice
+                stamps[corners[j]] = stamp - 1;
+                num_shared++;
+            }
+        }
+    }
+    return num_shared == 2;
+}
+
+static void free_scratch(void **scratch, int count) {
+    for (int i = 0; i < count; i++) {
+        free(scratch[i]);
+    }
+}
+
+// Out of memory, the level is left out
+static bool simplify_failed(void **scratch, int count) {
+    fprintf(stderr, "Error allocating memory to simplify a mesh\n");
+    free_scratch(scratch, count);
+    return false;
+}
+
+bool lod_simplify(const vec3_t *vertices, const face_t *faces, int target_faces,
+                  vec3_t **out_vertices, face_t **out_faces) {
+    int num_vertices = array_size((void *)vertices);
+    int num_faces = array_size((void *)faces);
+    if (num_faces <= 0)
+        return false;
+
+    face_t *work = malloc(sizeof(face_t) * num_faces);
+    uint8_t *dead = calloc(num_faces, sizeof(uint8_t));
+    int *welded = malloc(sizeof(int) * num_vertices);
+    uint8_t *locked = calloc(num_vertices, sizeof(uint8_t));
+    uint8_t *touched = malloc(num_vertices);
+    quadric_t *quadrics = calloc(num_vertices, sizeof(quadric_t));
+    collapse_t *edges = malloc(sizeof(collapse_t) * 3 * num_faces);
+    int *adjacent_offsets = malloc(sizeof(int) * (num_vertices + 1));
+    int *adjacent = malloc(sizeof(int) * 3 * num_faces);
+    int *stamps = calloc(num_vertices, sizeof(int));
+    int stamp = 0;
+
+    // Freed together whichever way this returns
+    void *scratch[] = {work,     dead,  welded,           locked,   touched,
+                       quadrics, edges, adjacent_offsets, adjacent, stamps};
+    int num_scratch = sizeof(scratch) / sizeof(scratch[0]);
+
+    bool allocated = true;
+    for (int i = 0; i < num_scratch; i++) {
+        allocated = allocated && scratch[i] != NULL;
+    }
+    // Work on welded indices, faces that weld down to a line or a point are dropped right away
+    if (!allocated || !weld_vertices(vertices, num_vertices, welded))
+        return simplify_failed(scratch, num_scratch);
+    int live_faces = num_faces;
+    for (int i = 0; i < num_faces; i++) {
+        work[i] = faces[i];
+        work[i].a = welded[work[i].a];
+        work[i].b = welded[work[i].b];
+        work[i].c = welded[work[i].c];
+        if (work[i].a == work[i].b || work[i].b == work[i].c || work[i].a == work[i].c) {
+            dead[i] = 1;
+            live_faces--;
+        }
+    }
+
+    if (!lock_vertices(work, dead, num_faces, locked))
+        return simplify_failed(scratch, num_scratch);
+
+    // Every vertex starts with the planes of its faces, weighted by area so slivers count less
+    for (int i = 0; i < num_faces; i++) {
+        if (dead[i])
+            continue;
+
+        vec3_t points[3] = {vertices[work[i].a], vertices[work[i].b], vertices[work[i].c]};
+        vec3_t normal = triangle_normal(points);
+        float length = vec3_length(normal);
+        if (length == 0.0f)
+            continue;
+
+        normal = vec3_div(normal, length);
+        quadric_t q = quadric_from_plane(normal.x, normal.y, normal.z,
+                                         -vec3_dot(normal, points[0]), length * 0.5f);
+        quadric_add(&quadrics[work[i].a], &q);
+        quadric_add(&quadrics[work[i].b], &q);
+        quadric_add(&quadrics[work[i].c], &q);
+    }
+
+    // Each pass collapses the cheapest edges whose neighbourhoods do not overlap, so the costs
+    // and adjacency computed at the start of the pass stay valid for every collapse in it
+    while (live_faces > target_faces) {
+        int num_edges = collect_edges(work, dead, num_faces, edges);
+
+        int num_candidates = 0;
+        for (int i = 0; i < num_edges; i++) {
+            int a = edges[i].a, b = edges[i].b;
+            quadric_t q = quadrics[a];
+            quadric_add(&q, &quadrics[b]);
+
+            // the locked end has to be the one that stays
+            bool can_keep_a = !locked[b], can_keep_b = !locked[a];
+            if (!can_keep_a && !can_keep_b)
+                continue;
+
+            double cost_to_a = quadric_error(&q, vertices[a]);
+            double cost_to_b = quadric_error(&q, vertices[b]);
+            bool keep_a = !can_keep_b || (can_keep_a && cost_to_a <= cost_to_b);
+            collapse_t candidate = {
+                .a = a,
+                .b = b,
+                .from = keep_a ? b : a,
+                .to = keep_a ? a : b,
+                .cost = keep_a ? cost_to_a : cost_to_b,
+            };
+            edges[num_candidates++] = candidate;
+        }
+        qsort(edges, num_candidates, sizeof(collapse_t), compare_costs);
+
+        // Faces around every vertex
+        memset(adjacent_offsets, 0, sizeof(int) * (num_vertices + 1));
+        for (int i = 0; i < num_faces; i++) {
+            if (dead[i])
+                continue;
+            adjacent_offsets[work[i].a + 1]++;
+            adjacent_offsets[work[i].b + 1]++;
+            adjacent_offsets[work[i].c + 1]++;
+        }
+        for (int i = 0; i < num_vertices; i++) {
+            adjacent_offsets[i + 1] += adjacent_offsets[i];
+        }
+        for (int i = 0; i < num_faces; i++) {
+            if (dead[i])
+                continue;
+            adjacent[adjacent_offsets[work[i].a]++] = i;
+            adjacent[adjacent_offsets[work[i].b]++] = i;
+            adjacent[adjacent_offsets[work[i].c]++] = i;
+        }
+        // filling moved every offset to the end of its list, shift them back
+        for (int i = num_vertices; i > 0; i--) {
+            adjacent_offsets[i] = adjacent_offsets[i - 1];
+        }
+        adjacent_offsets[0] = 0;
+
+        memset(touched, 0, num_vertices);
+        int num_collapsed = 0;
+        for (int i = 0; i < num_candidates && live_faces > target_faces; i++) {
+            int from = edges[i].from, to = edges[i].to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // two apart so the already counted mark of the last candidate never matches
+            stamp += 2;
+            if (!collapse_keeps_manifold(work, dead, adjacent_offsets, adjacent, from, to, stamps,
+                                         stamp))
+                continue;
+
+            const int *around = &adjacent[adjacent_offsets[from]];
+            int num_around = adjacent_offsets[from + 1] - adjacent_offsets[from];
+            if (!collapse_keeps_orientation(vertices, work, dead, around, num_around, from, to))
+                continue;
+
+            // The faces on the edge give the uv to has in each chart touching from, found by the
+            // uv from has there. A face with no match sits across a seam the edge does not run
+            // along, moving its corner would tear the texture
+            tex2_t from_uvs[4], to_uvs[4];
+            int num_charts = 0;
+            for (int j = 0; j < num_around && num_charts < 4; j++) {
+                face_t *face = &work[around[j]];
+                int corner = face_corner(face, to);
+                if (dead[around[j]] || corner == -1)
+                    continue;
+
+                from_uvs[num_charts] = *corner_uv(face, face_corner(face, from));
+                to_uvs[num_charts] = *corner_uv(face, corner);
+                num_charts++;
+            }
+
+            bool tears = false;
+            for (int j = 0; j < num_around && !tears; j++) {
+                face_t *face = &work[around[j]];
+                if (dead[around[j]] || face_corner(face, to) != -1)
+                    continue;
+
+                tex2_t uv = *corner_uv(face, face_corner(face, from));
+                tears = true;
+                for (int k = 0; k < num_charts; k++) {
+                    if (tex_equal(from_uvs[k], uv))
+                        tears = false;
+                }
+            }
+            if (tears)
+                continue;
+
+            for (int j = 0; j < num_around; j++) {
+                face_t *face = &work[around[j]];
+                if (dead[around[j]])
+                    continue;
+
+                touched[face->a] = touched[face->b] = touched[face->c] = 1;
+                if (face_corner(face, to) != -1) {
+                    dead[around[j]] = 1;
+                    live_faces--;
+                    continue;
+                }
+
+                int corner = face_corner(face, from);
+                tex2_t *uv = corner_uv(face, corner);
+                for (int k = 0; k < num_charts; k++) {
+                    if (tex_equal(from_uvs[k], *uv)) {
+                        *uv = to_uvs[k];
+                        break;
+                    }
+                }
+                *corner_index(face, corner) = to;
+            }
+
+            quadric_add(&quadrics[to], &quadrics[from]);
+            num_collapsed++;
+        }
+
+        if (num_collapsed == 0)
+            break;
+    }
+
+    // Drop the vertices nothing points at anymore, keeping their order
+    int *remap = malloc(sizeof(int) * num_vertices);
+    if (remap == NULL)
+        return simplify_failed(scratch, num_scratch);
+    for (int i = 0; i < num_vertices; i++) {
+        remap[i] = -1;
+    }
+    for (int i = 0; i < num_faces; i++) {
+        if (dead[i])
+            continue;
+        remap[work[i].a] = remap[work[i].b] = remap[work[i].c] = 0;
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        if (remap[i] == -1)
+            continue;
+        remap[i] = array_size(*out_vertices);
+        array_push(*out_vertices, vertices[i]);
+    }
+    for (int i = 0; i < num_faces; i++) {
+        if (dead[i])
+            continue;
+        face_t face = work[i];
+        face.a = remap[face.a];
+        face.b = remap[face.b];
+        face.c = remap[face.c];
+        array_push(*out_faces, face);
+    }
+
+    free(remap);
+    free_scratch(scratch, num_scratch);
+
+    return live_faces < num_faces;
+}
@@ -0,0 +1,15 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <stdbool.h>
+
+#include "triangle.h"
+#include "vector.h"
+
+// Quadric error edge collapse (Garland-Heckbert) down to at most target_faces, or until nothing
+// else can collapse without tearing a uv seam, moving an open border or flipping a face. Writes
+// new dynamic arrays with the unused vertices dropped, false if the mesh did not get any smaller
+bool lod_simplify(const vec3_t *vertices, const face_t *faces, int target_faces,
+                  vec3_t **out_vertices, face_t **out_faces);
+
+#endif
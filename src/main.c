@@ -1,27 +1,44 @@
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_keycode.h>
 
 #include "array.h"
 #include "camera.h"
+#include "capture.h"
 #include "clip.h"
 #include "color.h"
 #include "display.h"
 #include "light.h"
 #include "matrix.h"
+#include "memory.h"
 #include "mesh.h"
+#include "node.h"
+#include "perf.h"
 #include "scene.h"
+#include "trace.h"
 #include "triangle.h"
 #include "vector.h"
+#include "visibility.h"
 
 static bool is_running = false;
 static int previous_frame_time = 0;
 static float delta_time;
+static visibility_t visibility = {0};
+// Nothing on screen changes unless the camera or a node moved, a model loaded or a key was pressed
+static bool needs_redraw = true;
+// Written once the frame's triangles are set up, between update and render
+static bool capture_requested = false;
+// Pixel clicked on, picked before update so it is looked up in the frame that was on screen
+static bool pick_requested = false;
+static int pick_x, pick_y;
 
 // Poll for input while running
 static void process_input(camera_t *camera) {
+    TRACE_BEGIN("process_input");
     // TODO: make input smoother
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -30,6 +47,8 @@ static void process_input(camera_t *camera) {
             is_running = false;
             break;
         case SDL_KEYDOWN:
+            needs_redraw = true;
+
             if (event.key.keysym.sym == SDLK_ESCAPE)
                 is_running = false;
 
@@ -45,6 +64,10 @@ static void process_input(camera_t *camera) {
                 set_render_mode(RENDER_TEXTURE);
             if (event.key.keysym.sym == SDLK_6)
                 set_render_mode(RENDER_TEXTURE_WIRE);
+            if (event.key.keysym.sym == SDLK_7)
+                set_render_mode(RENDER_TEXTURE_SPAN);
+            if (event.key.keysym.sym == SDLK_8)
+                set_render_mode(RENDER_TEXTURE_VISIBILITY);
 
             // camera y control
             if (event.key.keysym.sym == SDLK_SPACE)
@@ -89,9 +112,29 @@ static void process_input(camera_t *camera) {
 
             if (event.key.keysym.sym == SDLK_b)
                 switch_cull_mode();
+            if (event.key.keysym.sym == SDLK_l)
+                switch_texture_span_length();
+            if (event.key.keysym.sym == SDLK_f)
+                capture_requested = true;
+            if (event.key.keysym.sym == SDLK_h)
+                perf_switch();
+            if (event.key.keysym.sym == SDLK_t)
+                TRACE_DUMP(TRACE_FILE_NAME);
+            if (event.key.keysym.sym == SDLK_n)
+                switch_texture_filter();
+            if (event.key.keysym.sym == SDLK_m)
+                memory_report();
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_LEFT) {
+                pick_requested = true;
+                pick_x = event.button.x;
+                pick_y = event.button.y;
+            }
             break;
         }
     }
+    TRACE_END();
 }
 
 // Might be thought of as our vertex shader, takes a scene and transforms all the meshes from model
@@ -114,6 +157,7 @@ static void update(scene_t *scene) {
     delta_time = (SDL_GetTicks() - previous_frame_time) / SECOND;
 
     previous_frame_time = SDL_GetTicks();
+    TRACE_BEGIN("update");
 
     int window_width, window_height;
     get_window_size(&window_width, &window_height);
@@ -123,66 +167,106 @@ static void update(scene_t *scene) {
     mat4_t view_matrix =
         mat4_make_look_at(scene->camera.position, target, scene->camera.up_direction);
 
-    int num_meshes = array_size(scene->meshes);
-    for (int m = 0; m < num_meshes; m++) {
+    // Cached model-view matrices only need rebuilding when the camera actually moved
+    bool view_changed = memcmp(&view_matrix, &scene->view_matrix, sizeof(mat4_t)) != 0;
+    if (view_changed) {
+        scene->view_matrix = view_matrix;
+        scene->view_version++;
+    }
+
+    // Only nodes that moved, or sit below one that did, rebuild their world matrix
+    int num_moved = nodes_update(scene->nodes, &scene->view_matrix, scene->view_version);
+
+    // Models that finished loading in the background join here, never in the middle of a frame
+    bool loaded = scene_poll_loads(scene);
+
+    // Same view of the same scene, last frame's triangles and texture are still right
+    needs_redraw |= view_changed || num_moved > 0 || loaded;
+    if (!needs_redraw) {
+        TRACE_END();
+        return;
+    }
+
+    // Whole subtrees of meshes outside the frustum are skipped without looking at them, and
+    // meshes behind the big ones in front never reach the geometry stage
+    scene_update_visibility(scene, num_moved > 0, view_changed, window_height);
+
+    // Which local lights reach which part of the screen, so faces only look at the ones near them
+    TRACE_BEGIN("light_grid");
+    light_grid_build(&scene->light_grid, scene->lights, &scene->view_matrix,
+                     &scene->projection_matrix, scene->frustum_planes, window_width,
+                     window_height);
+    TRACE_END();
+
+    // The same for every face this frame
+    vec3_normalize(&scene->light.direction);
+
+    int num_visible = array_size(scene->visible_meshes);
+    for (int v = 0; v < num_visible; v++) {
         // get pointers since we are going to modify these
-        mesh_t *mesh = &scene->meshes[m];
+        mesh_t *mesh = &scene->meshes[scene->visible_meshes[v]];
+        TRACE_BEGIN_ID("mesh", scene->visible_meshes[v]);
 
         // reset the triangles each frame
         array_reset(mesh->raster_tris);
 
-        mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-        mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
-        mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
-        mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
-        mat4_t translation_matrix =
-            mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
-
-        // Combine all transforms, scale, rotate, translate, in that order
-        mat4_t world_matrix = mat4_identity();
-        world_matrix = mat4_mul_mat4(&scale_matrix, &world_matrix);
-        world_matrix = mat4_mul_mat4(&rotation_matrix_z, &world_matrix);
-        world_matrix = mat4_mul_mat4(&rotation_matrix_y, &world_matrix);
-        world_matrix = mat4_mul_mat4(&rotation_matrix_x, &world_matrix);
-        world_matrix = mat4_mul_mat4(&translation_matrix, &world_matrix);
+        const node_t *node = &scene->nodes[mesh->node];
+        const model_t *model = &scene->models[mesh->model];
+        const mesh_lod_t *lod = &model->lods[mesh->lod];
+
+        perf_begin(PERF_STAGE_TRANSFORM);
+
+        // Backface culling happens in model space before anything is transformed
+        bool cull = should_cull_bface();
+        if (cull)
+            mesh_update_front_faces(mesh, model, &node->inverse_world_matrix, node->mirrored,
+                                    scene->camera.position);
+
+        // Every vertex to view space once, shared by the wire and triangle paths
+        mat4_mul_points_soa(&node->model_view_matrix, lod->positions, mesh->view_positions,
+                            array_size(lod->vertices));
+        vec3_soa_t view = mesh->view_positions;
+
+        // Wire modes project each vertex once and only emit unique edges
+        if (should_render_wire()) {
+            wireframe_update(&mesh->wire, lod->edges, view, array_size(lod->vertices),
+                             cull ? mesh->front_faces : NULL, &scene->projection_matrix,
+                             scene->frustum_planes[NEAR_FRUSTUM].point.z,
+                             scene->frustum_planes[FAR_FRUSTUM].point.z);
+        }
+
+        perf_end(PERF_STAGE_TRANSFORM);
+
+        // Nothing else to do if we are only drawing edges
+        if (!should_render_tris()) {
+            TRACE_END();
+            continue;
+        }
+
+        perf_begin(PERF_STAGE_CLIP);
+        TRACE_BEGIN("clip");
 
         // Loop faces first, get vertices from faces, project triangle, add to array
-        int num_faces = array_size(mesh->faces);
+        int num_faces = array_size(lod->faces);
         for (int i = 0; i < num_faces; i++) {
+            // Skip transforming, projecting and pushing this triangle to render, if face is
+            // looking away from camera
+            if (cull && !mesh->front_faces[i])
+                continue;
 
-            // Find vertices in face
-            vec3_t face_vertices[3] = {
-                mesh->vertices[mesh->faces[i].a],
-                mesh->vertices[mesh->faces[i].b],
-                mesh->vertices[mesh->faces[i].c],
-            };
-
-            // Transform vertices to view space
+            // Find already transformed vertices in face
+            int indices[3] = {lod->faces[i].a, lod->faces[i].b, lod->faces[i].c};
             vec3_t transformed_vertices[3];
             for (int j = 0; j < 3; j++) {
-                vec4_t transformed_vertex = vec3_to_vec4(face_vertices[j]);
-
-                // To world space
-                transformed_vertex = mat4_mul_vec4(&world_matrix, transformed_vertex);
-
-                // To camera space
-                transformed_vertex = mat4_mul_vec4(&view_matrix, transformed_vertex);
-
-                transformed_vertices[j] = vec4_to_vec3(transformed_vertex);
+                transformed_vertices[j] =
+                    (vec3_t){view.x[indices[j]], view.y[indices[j]], view.z[indices[j]]};
             }
 
-            // Shading and backface culling need triangle normal
+            // Shading needs the view space triangle normal
             vec3_t face_normal = triangle_normal(transformed_vertices);
-
-            // origin is now camera position after camera space transformation
-            vec3_t camera_ray = vec3_sub((vec3_t){0, 0, 0}, transformed_vertices[1]);
-
-            // Skip projecting and pushing this triangle to render, if face is
-            // looking away from camera
-            if (should_cull_bface()) {
-                if (vec3_dot(camera_ray, face_normal) < 0.0f)
-                    continue;
-            }
+            vec3_normalize(&face_normal);
+            // Negative because pointing at the light means more light
+            float light_alignment = -vec3_dot(scene->light.direction, face_normal);
 
             // Perform frustum clipping
             polygon_t clip_poly = {
@@ -194,9 +278,9 @@ static void update(scene_t *scene) {
                     },
                 .tex_coords =
                     {
-                        mesh->faces[i].a_uv,
-                        mesh->faces[i].b_uv,
-                        mesh->faces[i].c_uv,
+                        lod->faces[i].a_uv,
+                        lod->faces[i].b_uv,
+                        lod->faces[i].c_uv,
                     },
                 .num_vertices = 3,
             };
@@ -229,12 +313,16 @@ static void update(scene_t *scene) {
                     projected_vertices[j].y += (window_height / 2.f);
                 }
 
-                // Flat shading
-                vec3_normalize(&scene->light.direction);
-                vec3_normalize(&face_normal);
-                // Negative because pointing at the light means more light
-                float light_alignment = -vec3_dot(scene->light.direction, face_normal);
-                color_t shaded_color = light_apply_intensity(mesh->faces[i].color, light_alignment);
+                // Flat shading, local lights are taken at the middle of what is left after
+                // clipping, which is always on screen and so in the tile it was binned for
+                vec3_t center = {0};
+                for (int j = 0; j < 3; j++) {
+                    center = vec3_add(center, vec4_to_vec3(clipped_triangle.points[j]));
+                }
+                center = vec3_div(center, 3.0f);
+                float light_factor =
+                    light_alignment + light_grid_shade(&scene->light_grid, center, face_normal);
+                color_t shaded_color = light_apply_intensity(lod->faces[i].color, light_factor);
 
                 // Not necessary to divide by 3 here, does not change relative ordering
                 float avg_z = transformed_vertices[0].z + transformed_vertices[1].z +
@@ -257,86 +345,167 @@ static void update(scene_t *scene) {
                     .avg_depth = avg_z,
                 };
 
-                array_push(mesh->raster_tris, triangle_to_render);
+                // Everything the rasterizer needs is worked out once here, nothing without area
+                // could be drawn anyway
+                triangle_setup_t setup;
+                if (!triangle_setup_init(&setup, &triangle_to_render))
+                    continue;
+                mesh->raster_tris = array_hold_aligned(mesh->raster_tris, 1, sizeof(setup));
+                mesh->raster_tris[array_size(mesh->raster_tris) - 1] = setup;
             }
         }
+        perf_end(PERF_STAGE_CLIP);
+        TRACE_END();
 
         // Sorting painters algorithm, like old days when memory was more
         // expensive
         if (should_render_ps1()) {
+            perf_begin(PERF_STAGE_SORT);
+            TRACE_BEGIN("qsort");
             qsort(mesh->raster_tris, array_size(mesh->raster_tris), sizeof(*(mesh->raster_tris)),
                   triangle_painter_compare);
+            TRACE_END();
+            perf_end(PERF_STAGE_SORT);
         }
+        TRACE_END();
     }
+    TRACE_END();
 }
 
 // Might be thought of as our rasterizer and fragment shader, takes the screen meshes and draws them
 static void render(scene_t *scene) {
+    if (!needs_redraw) {
+        render_previous_frame();
+        return;
+    }
+    needs_redraw = false;
+    TRACE_BEGIN("render");
+
+    perf_begin(PERF_STAGE_CLEAR);
+    begin_color_buffer();
     clear_color_buffer(BLACK);
     clear_w_buffer();
     draw_grid(GREY);
 
-    int num_meshes = array_size(scene->meshes);
-    for (int m = 0; m < num_meshes; m++) {
-        mesh_t *mesh = &scene->meshes[m];
+    bool deferred = should_render_visibility();
+    if (deferred)
+        visibility_clear(&visibility);
+    perf_end(PERF_STAGE_CLEAR);
 
-        int num_triangles = array_size(mesh->raster_tris);
-        for (int i = 0; i < num_triangles; i++) {
-            triangle_t triangle = mesh->raster_tris[i];
-            // Rasterization method requires vertices to run from top to bottom
-            sort_triangle_by_y(&triangle);
+    perf_begin(PERF_STAGE_RASTER);
+    int total_triangles = 0;
 
-            // FIXME: passing triangle by reference causes some to not be rendered
+    int num_visible = array_size(scene->visible_meshes);
+    for (int v = 0; v < num_visible; v++) {
+        mesh_t *mesh = &scene->meshes[scene->visible_meshes[v]];
+        const texture_t *texture = &scene->models[mesh->model].texture;
+        const wireframe_t *wire = &mesh->wire;
 
-            // Draw Textured Triangles
-            if (should_render_texture()) {
-                draw_textured_triangle(triangle, &mesh->texture);
-            }
+        int num_triangles = array_size(mesh->raster_tris);
+        total_triangles += num_triangles;
 
-            // Draw Filled Triangles
-            if (should_render_fill()) {
-                draw_filled_triangle(triangle);
+        // Only depth and ids for now, shading waits until every mesh is in
+        if (deferred) {
+            int id = visibility_add_mesh(&visibility, mesh->raster_tris, num_triangles, texture);
+            for (int i = 0; i < num_triangles; i++) {
+                visibility_draw_triangle(&visibility, id, i);
             }
+            continue;
+        }
 
-            // Draw Unfilled Triangles
-            if (should_render_wire()) {
-                draw_triangle(roundf(triangle.points[0].x), roundf(triangle.points[0].y),
-                              roundf(triangle.points[1].x), roundf(triangle.points[1].y),
-                              roundf(triangle.points[2].x), roundf(triangle.points[2].y), GREEN);
-            }
+        draw_mesh_triangles(mesh->raster_tris, num_triangles, texture);
 
-            // Draw Vertices
-            if (should_render_verts()) {
-                for (int j = 0; j < 3; j++) {
-                    draw_rectangle(roundf(triangle.points[j].x) - 3,
-                                   roundf(triangle.points[j].y) - 3, 6, 6, GREEN);
-                }
+        // Draw Unfilled Triangles, each shared edge only once
+        if (should_render_wire()) {
+            int num_lines = array_size(wire->lines);
+            for (int i = 0; i < num_lines; i++) {
+                line_t line = wire->lines[i];
+                draw_clipped_line(line.x0, line.y0, line.x1, line.y1, GREEN);
             }
+        }
 
-            // SECRET!
-            if (should_render_ps1()) {
-                draw_affine_textured_triangle(triangle, &mesh->texture);
+        // Draw Vertices, each shared vertex only once
+        if (should_render_verts()) {
+            int num_points = array_size(wire->points);
+            for (int i = 0; i < num_points; i++) {
+                vec2_t point = wire->points[i];
+                draw_rectangle(roundf(point.x) - 3, roundf(point.y) - 3, 6, 6, GREEN);
             }
         }
     }
 
+    // Every covered pixel shaded once, no matter how many triangles were drawn over it
+    if (deferred)
+        visibility_resolve(&visibility);
+    perf_end(PERF_STAGE_RASTER);
+
+    perf_begin(PERF_STAGE_PRESENT);
+    TRACE_BEGIN("render_color_buffer");
     render_color_buffer();
+    TRACE_END();
+    perf_end(PERF_STAGE_PRESENT);
+
+    int window_width, window_height;
+    get_window_size(&window_width, &window_height);
+    perf_end_frame(total_triangles, window_width * window_height);
+    TRACE_END();
+}
+
+// Prints the mesh under a pixel, and every mesh whose bounds hold the point it was hit at
+static void pick(const scene_t *scene, int x, int y) {
+    int window_width, window_height;
+    get_window_size(&window_width, &window_height);
+
+    vec3_t origin, direction;
+    scene_pixel_ray(scene, x, y, window_width, window_height, &origin, &direction);
+    float t;
+    int picked = scene_pick_mesh(scene, origin, direction, &t);
+    if (picked < 0) {
+        printf("pick %d, %d: no mesh\n", x, y);
+        return;
+    }
+
+    vec3_t hit = vec3_add(origin, vec3_mul(direction, t));
+    int *overlapping = NULL;
+    scene_query_point(scene, hit, &overlapping);
+    printf("pick %d, %d: mesh %d (%s) at %.2f, %.2f, %.2f, inside the bounds of %d meshes\n", x,
+           y, picked, loader_model_name(&scene->loader, scene->meshes[picked].model), hit.x, hit.y,
+           hit.z, array_size(overlapping));
+    array_free(overlapping);
 }
 
 int main(int argc, char *args[]) {
     is_running = window_init();
+    visibility_init(&visibility);
 
+    // The window is up before anything loads, meshes show up as their models finish
     scene_t scene = {0};
-    scene_init(&scene);
+    scene_init(&scene, argc > 1 ? args[1] : "./assets/scene.txt");
 
     while (is_running) {
         process_input(&scene.camera);
+        if (pick_requested) {
+            pick(&scene, pick_x, pick_y);
+            pick_requested = false;
+        }
         update(&scene);
+        if (capture_requested) {
+            capture_write(&scene, CAPTURE_FILE_NAME);
+            capture_requested = false;
+        }
         render(&scene);
     }
 
+    // Peaks of the whole run, and whatever is still held at the end
+    memory_report();
+    perf_free();
     scene_free(&scene);
+    visibility_free(&visibility);
     window_free();
 
+    // Loaders have stopped, everything they traced is in
+    TRACE_DUMP(TRACE_FILE_NAME);
+    TRACE_FREE();
+
     return 0;
 }
@@ -1,26 +1,365 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <math.h>
+
+#include "simd.h"
 #include "vector.h"
 
+// Header only, like vector.h, so everything can inline into the hot loops
+
 typedef struct {
     float m[4][4];
 } mat4_t;
 
-mat4_t mat4_identity(void);
+static inline mat4_t mat4_identity(void) {
+    mat4_t i = {.m = {
+                    {1, 0, 0, 0},
+                    {0, 1, 0, 0},
+                    {0, 0, 1, 0},
+                    {0, 0, 0, 1},
+                }};
+    return i;
+}
+
+static inline mat4_t mat4_make_scale(float sx, float sy, float sz) {
+    mat4_t s = mat4_identity();
+    s.m[0][0] = sx;
+    s.m[1][1] = sy;
+    s.m[2][2] = sz;
+
+    return s;
+}
+
+static inline mat4_t mat4_make_rotation_x(float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+
+    mat4_t rx = mat4_identity();
+    rx.m[1][1] = c;
+    rx.m[1][2] = -s;
+    rx.m[2][1] = s;
+    rx.m[2][2] = c;
+
+    return rx;
+}
+
+static inline mat4_t mat4_make_rotation_y(float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+
+    mat4_t ry = mat4_identity();
+    ry.m[0][0] = c;
+    ry.m[0][2] = s;
+    ry.m[2][0] = -s;
+    ry.m[2][2] = c;
+
+    return ry;
+}
+
+static inline mat4_t mat4_make_rotation_z(float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+
+    mat4_t rz = mat4_identity();
+    rz.m[0][0] = c;
+    rz.m[0][1] = -s;
+    rz.m[1][0] = s;
+    rz.m[1][1] = c;
+
+    return rz;
+}
+
+static inline mat4_t mat4_make_translation(float tx, float ty, float tz) {
+    mat4_t t = mat4_identity();
+    t.m[0][3] = tx;
+    t.m[1][3] = ty;
+    t.m[2][3] = tz;
+    return t;
+}
+
+static inline mat4_t mat4_make_look_at(vec3_t eye, vec3_t target, vec3_t up) {
+    vec3_t z = vec3_sub(target, eye);
+    vec3_normalize(&z);
+    vec3_t x = vec3_cross(up, z);
+    vec3_normalize(&x);
+
+    // already normal
+    vec3_t y = vec3_cross(z, x);
+
+    mat4_t v = {
+        {{x.x, x.y, x.z, -vec3_dot(x, eye)},
+         {y.x, y.y, y.z, -vec3_dot(y, eye)},
+         {z.x, z.y, z.z, -vec3_dot(z, eye)},
+         {0.f, 0.f, 0.f, 1.f}},
+    };
+
+    return v;
+}
+
+static inline mat4_t mat4_make_perspective(float fov, float inv_aspect, float znear,
+                                           float zfar) {
+    mat4_t p = {.m = {{0}}};
+
+    p.m[0][0] = inv_aspect * (1.0f / tan(fov / 2.0f)); // x normalization
+    p.m[1][1] = (1.0f / tan(fov / 2.0f));              // y normalization
+    p.m[2][2] = zfar / (zfar - znear);                 // z normalization
+    p.m[2][3] = (-zfar * znear) / (zfar - znear);      // z offset by znear
+    p.m[3][2] = 1.0f;                                  // z stored in w, for perspective divide
+
+    return p;
+}
+
+static inline vec4_t mat4_mul_vec4(const mat4_t *m, vec4_t v) {
+#if defined(SIMD_SSE)
+    // Multiply every row by v, transpose, then the four dot products are one column sum away
+    __m128 v4 = _mm_loadu_ps(&v.x);
+    __m128 row0 = _mm_mul_ps(_mm_loadu_ps(m->m[0]), v4);
+    __m128 row1 = _mm_mul_ps(_mm_loadu_ps(m->m[1]), v4);
+    __m128 row2 = _mm_mul_ps(_mm_loadu_ps(m->m[2]), v4);
+    __m128 row3 = _mm_mul_ps(_mm_loadu_ps(m->m[3]), v4);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+    vec4_t result;
+    _mm_storeu_ps(&result.x, _mm_add_ps(_mm_add_ps(row0, row1), _mm_add_ps(row2, row3)));
+#else
+    vec4_t result = {
+        .x = m->m[0][0] * v.x + m->m[0][1] * v.y + m->m[0][2] * v.z + m->m[0][3] * v.w,
+        .y = m->m[1][0] * v.x + m->m[1][1] * v.y + m->m[1][2] * v.z + m->m[1][3] * v.w,
+        .z = m->m[2][0] * v.x + m->m[2][1] * v.y + m->m[2][2] * v.z + m->m[2][3] * v.w,
+        .w = m->m[3][0] * v.x + m->m[3][1] * v.y + m->m[3][2] * v.z + m->m[3][3] * v.w,
+    };
+#endif
+
+    return result;
+}
+
+static inline vec4_t mat4_mul_vec4_project(const mat4_t *p, vec4_t v) {
+    vec4_t result = mat4_mul_vec4(p, v); // normal multiplication
+
+    // Perspective divide by original z (stored in w), making sure to avoid div
+    // by zero
+    if (result.w != 0.0f) {
+        result.x /= result.w;
+        result.y /= result.w;
+        result.z /= result.w;
+    }
+
+    return result;
+}
+
+static inline mat4_t mat4_mul_mat4(const mat4_t *a, const mat4_t *b) {
+    mat4_t result;
+
+#if defined(SIMD_SSE)
+    // Rows of b are contiguous, so each result row is a weighted sum of them
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    __m128 b3 = _mm_loadu_ps(b->m[3]);
+    for (int row = 0; row < 4; row++) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a->m[row][0]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a->m[row][1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a->m[row][2]), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a->m[row][3]), b3));
+        _mm_storeu_ps(result.m[row], sum);
+    }
+#else
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            float dot = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                dot += a->m[row][i] * b->m[i][col];
+            }
+            result.m[row][col] = dot;
+        }
+    }
+#endif
+
+    return result;
+}
+
+// Laplace expansion over the top two and bottom two rows, 2x2 sub-determinants shared with
+// mat4_inverse
+static inline float mat4_determinant(const mat4_t *m) {
+    const float(*a)[4] = m->m;
+
+    float s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    float s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    float s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    float s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    float s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    float s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+
+    float c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    float c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    float c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    float c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    float c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    float c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
 
-mat4_t mat4_make_scale(float sx, float sy, float sz);
-mat4_t mat4_make_rotation_x(float angle);
-mat4_t mat4_make_rotation_y(float angle);
-mat4_t mat4_make_rotation_z(float angle);
-mat4_t mat4_make_translation(float tx, float ty, float tz);
+// General inverse, returns the identity if m is singular
+static inline mat4_t mat4_inverse(const mat4_t *m) {
+    const float(*a)[4] = m->m;
 
-mat4_t mat4_make_look_at(vec3_t eye, vec3_t target, vec3_t up);
+    float s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    float s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    float s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    float s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    float s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    float s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
 
-mat4_t mat4_make_perspective(float fov, float inv_aspect, float znear, float zfar);
+    float c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    float c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    float c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    float c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    float c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    float c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
 
-vec4_t mat4_mul_vec4(const mat4_t *m, vec4_t v);
-vec4_t mat4_mul_vec4_project(const mat4_t *p, vec4_t v);
-mat4_t mat4_mul_mat4(const mat4_t *a, const mat4_t *b);
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == 0.0f)
+        return mat4_identity();
+
+    float inv_det = 1.0f / det;
+
+    mat4_t inverse = {.m = {
+                          {
+                              (a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3) * inv_det,
+                              (-a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3) * inv_det,
+                              (a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3) * inv_det,
+                              (-a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3) * inv_det,
+                          },
+                          {
+                              (-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1) * inv_det,
+                              (a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1) * inv_det,
+                              (-a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1) * inv_det,
+                              (a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1) * inv_det,
+                          },
+                          {
+                              (a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0) * inv_det,
+                              (-a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0) * inv_det,
+                              (a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0) * inv_det,
+                              (-a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0) * inv_det,
+                          },
+                          {
+                              (-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0) * inv_det,
+                              (a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0) * inv_det,
+                              (-a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0) * inv_det,
+                              (a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0) * inv_det,
+                          },
+                      }};
+
+    return inverse;
+}
+
+// Batch functions
+
+// Transforms count points (w = 1) from in to out, only the top three rows are used so m must be
+// affine, world/view/model-view are, a projection is not. in and out may not overlap
+static inline void mat4_mul_points_soa(const mat4_t *m, vec3_soa_t in, vec3_soa_t out, int count) {
+    int i = 0;
+#if defined(SIMD_AVX)
+    __m256 m8[3][4];
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            m8[row][col] = _mm256_set1_ps(m->m[row][col]);
+        }
+    }
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(in.x + i);
+        __m256 y = _mm256_loadu_ps(in.y + i);
+        __m256 z = _mm256_loadu_ps(in.z + i);
+        float *outs[3] = {out.x, out.y, out.z};
+        for (int row = 0; row < 3; row++) {
+            __m256 sum = _mm256_add_ps(_mm256_mul_ps(m8[row][0], x), m8[row][3]);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(m8[row][1], y));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(m8[row][2], z));
+            _mm256_storeu_ps(outs[row] + i, sum);
+        }
+    }
+#endif
+#if defined(SIMD_SSE)
+    __m128 m4[3][4];
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            m4[row][col] = _mm_set1_ps(m->m[row][col]);
+        }
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(in.x + i);
+        __m128 y = _mm_loadu_ps(in.y + i);
+        __m128 z = _mm_loadu_ps(in.z + i);
+        float *outs[3] = {out.x, out.y, out.z};
+        for (int row = 0; row < 3; row++) {
+            __m128 sum = _mm_add_ps(_mm_mul_ps(m4[row][0], x), m4[row][3]);
+            sum = _mm_add_ps(sum, _mm_mul_ps(m4[row][1], y));
+            sum = _mm_add_ps(sum, _mm_mul_ps(m4[row][2], z));
+            _mm_storeu_ps(outs[row] + i, sum);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float x = in.x[i], y = in.y[i], z = in.z[i];
+        out.x[i] = m->m[0][0] * x + m->m[0][1] * y + m->m[0][2] * z + m->m[0][3];
+        out.y[i] = m->m[1][0] * x + m->m[1][1] * y + m->m[1][2] * z + m->m[1][3];
+        out.z[i] = m->m[2][0] * x + m->m[2][1] * y + m->m[2][2] * z + m->m[2][3];
+    }
+}
+
+// Projects count view space points, perspective divides, and maps them onto the screen, y flipped
+// as models have the opposite y axis. out.w keeps the original view z like mat4_mul_vec4_project.
+// Points with w == 0 are not divided, points behind the camera come out as garbage so clip first
+// or ignore them
+static inline void mat4_project_to_screen_soa(const mat4_t *p, vec3_soa_t in, vec4_soa_t out,
+                                              float half_width, float half_height, int count) {
+    int i = 0;
+#if defined(SIMD_SSE)
+    __m128 p4[4][4];
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            p4[row][col] = _mm_set1_ps(p->m[row][col]);
+        }
+    }
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 half_w = _mm_set1_ps(half_width);
+    __m128 half_h = _mm_set1_ps(half_height);
+    __m128 neg_half_h = _mm_set1_ps(-half_height);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(in.x + i);
+        __m128 y = _mm_loadu_ps(in.y + i);
+        __m128 z = _mm_loadu_ps(in.z + i);
+
+        __m128 clip[4];
+        for (int row = 0; row < 4; row++) {
+            clip[row] = _mm_add_ps(_mm_mul_ps(p4[row][0], x), p4[row][3]);
+            clip[row] = _mm_add_ps(clip[row], _mm_mul_ps(p4[row][1], y));
+            clip[row] = _mm_add_ps(clip[row], _mm_mul_ps(p4[row][2], z));
+        }
+
+        // divide by 1 where w is 0
+        __m128 nonzero = _mm_cmpneq_ps(clip[3], zero);
+        __m128 w = _mm_or_ps(_mm_and_ps(nonzero, clip[3]), _mm_andnot_ps(nonzero, one));
+        __m128 inv_w = _mm_div_ps(one, w);
+
+        __m128 screen_x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[0], inv_w), half_w), half_w);
+        __m128 screen_y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[1], inv_w), neg_half_h), half_h);
+        _mm_storeu_ps(out.x + i, screen_x);
+        _mm_storeu_ps(out.y + i, screen_y);
+        _mm_storeu_ps(out.z + i, _mm_mul_ps(clip[2], inv_w));
+        _mm_storeu_ps(out.w + i, clip[3]);
+    }
+#endif
+    for (; i < count; i++) {
+        vec4_t projected = mat4_mul_vec4_project(p, (vec4_t){in.x[i], in.y[i], in.z[i], 1.0f});
+        out.x[i] = projected.x * half_width + half_width;
+        out.y[i] = projected.y * -half_height + half_height;
+        out.z[i] = projected.z;
+        out.w[i] = projected.w;
+    }
+}
 
 #endif
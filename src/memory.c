@@ -0,0 +1,163 @@
+#include "memory.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "array.h"
+
+#define MEMORY_MAX_NAME 64
+
+static const char *const category_names[NUM_MEMORY_CATEGORIES] = {
+    "other", "vertices", "faces", "raster triangles", "textures", "color buffer", "depth buffer",
+};
+
+// Row 0 is no asset, every other row is the asset one before it
+typedef struct {
+    int64_t live[NUM_MEMORY_CATEGORIES][MEMORY_MAX_ASSETS + 1];
+    int64_t peak[NUM_MEMORY_CATEGORIES][MEMORY_MAX_ASSETS + 1];
+    int64_t category_live[NUM_MEMORY_CATEGORIES], category_peak[NUM_MEMORY_CATEGORIES];
+    int64_t total_live, total_peak;
+} memory_counts_t;
+
+typedef struct {
+    void *array;    // NULL if the slot is free
+    int high_water; // largest size it had before shrinking, it may be bigger right now
+    int next_free;  // next slot of the free list while this one is on it
+} tracked_array_t;
+
+static memory_counts_t counts;
+static char asset_names[MEMORY_MAX_ASSETS][MEMORY_MAX_NAME];
+static tracked_array_t tracked[MEMORY_MAX_TRACKED];
+static SDL_SpinLock tracked_lock = 0;
+static int num_tracked_slots = 0; // slots ever handed out, the rest were never used
+static int first_free_slot = -1;  // freed slots, handed out again before new ones
+static bool tracked_full = false;
+
+static int asset_row(int asset) {
+    return asset >= 0 && asset < MEMORY_MAX_ASSETS ? asset + 1 : 0;
+}
+
+// Raises the peak to live if it is higher, another thread may be raising it at the same time
+static void raise_peak(int64_t *peak, int64_t live) {
+    int64_t seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (live > seen &&
+           !__atomic_compare_exchange_n(peak, &seen, live, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+}
+
+static void add(int64_t *live, int64_t *peak, long long bytes) {
+    int64_t now = __atomic_add_fetch(live, bytes, __ATOMIC_RELAXED);
+    raise_peak(peak, now);
+}
+
+void memory_add(memory_category_e category, int asset, long long bytes) {
+    int row = asset_row(asset);
+    add(&counts.live[category][row], &counts.peak[category][row], bytes);
+    add(&counts.category_live[category], &counts.category_peak[category], bytes);
+    add(&counts.total_live, &counts.total_peak, bytes);
+}
+
+void memory_name_asset(int asset, const char *name) {
+    if (asset >= 0 && asset < MEMORY_MAX_ASSETS)
+        snprintf(asset_names[asset], MEMORY_MAX_NAME, "%s", name);
+}
+
+void memory_lock(void) { SDL_AtomicLock(&tracked_lock); }
+void memory_unlock(void) { SDL_AtomicUnlock(&tracked_lock); }
+
+int memory_track(void *array) {
+    int slot = first_free_slot;
+    if (slot >= 0) {
+        first_free_slot = tracked[slot].next_free;
+    } else if (num_tracked_slots < MEMORY_MAX_TRACKED) {
+        slot = num_tracked_slots++;
+    } else {
+        if (!tracked_full)
+            fprintf(stderr,
+                    "Error tracking array, more than %d tagged, the rest aren't checked for "
+                    "wasted capacity\n",
+                    MEMORY_MAX_TRACKED);
+        tracked_full = true;
+        return -1;
+    }
+
+    tracked[slot] = (tracked_array_t){.array = array};
+    return slot;
+}
+
+void memory_retrack(int slot, void *array) { tracked[slot].array = array; }
+
+void memory_untrack(int slot) {
+    tracked[slot] = (tracked_array_t){.next_free = first_free_slot};
+    first_free_slot = slot;
+}
+
+// Only the owning thread raises it, the report may be reading it at the same time
+void memory_slot_shrink(int slot, int size) {
+    if (size > __atomic_load_n(&tracked[slot].high_water, __ATOMIC_RELAXED))
+        __atomic_store_n(&tracked[slot].high_water, size, __ATOMIC_RELAXED);
+}
+
+static double kilobytes(int64_t bytes) { return bytes / 1024.0; }
+
+static void print_asset_name(int row) {
+    if (row == 0)
+        printf("  %-20s", "renderer");
+    else if (asset_names[row - 1][0] != '\0')
+        printf("  %-20s", asset_names[row - 1]);
+    else
+        printf("  asset %-14d", row - 1);
+}
+
+void memory_report(void) {
+    printf("memory, live and peak in KB\n");
+    for (int c = 0; c < NUM_MEMORY_CATEGORIES; c++) {
+        printf("  %-20s %12.1f %12.1f\n", category_names[c],
+               kilobytes(__atomic_load_n(&counts.category_live[c], __ATOMIC_RELAXED)),
+               kilobytes(__atomic_load_n(&counts.category_peak[c], __ATOMIC_RELAXED)));
+    }
+    printf("  %-20s %12.1f %12.1f\n", "total",
+           kilobytes(__atomic_load_n(&counts.total_live, __ATOMIC_RELAXED)),
+           kilobytes(__atomic_load_n(&counts.total_peak, __ATOMIC_RELAXED)));
+
+    printf("memory per asset, live and peak in KB\n");
+    for (int row = 0; row <= MEMORY_MAX_ASSETS; row++) {
+        for (int c = 0; c < NUM_MEMORY_CATEGORIES; c++) {
+            int64_t peak = __atomic_load_n(&counts.peak[c][row], __ATOMIC_RELAXED);
+            if (peak == 0)
+                continue;
+            print_asset_name(row);
+            printf(" %-18s %12.1f %12.1f\n", category_names[c],
+                   kilobytes(__atomic_load_n(&counts.live[c][row], __ATOMIC_RELAXED)),
+                   kilobytes(peak));
+        }
+    }
+
+    // Locked so no array moves or goes away while its header is read
+    printf("arrays holding over %dx what they use\n", MEMORY_WASTE_RATIO);
+    memory_lock();
+    for (int slot = 0; slot < num_tracked_slots; slot++) {
+        const tracked_array_t *entry = &tracked[slot];
+        if (entry->array == NULL)
+            continue;
+
+        // Scratch reset every frame is measured by the most it held, not by what is left in it
+        int used = array_size(entry->array);
+        int high_water = __atomic_load_n(&entry->high_water, __ATOMIC_RELAXED);
+        if (high_water > used)
+            used = high_water;
+        int capacity = array_capacity(entry->array);
+        int64_t unused = (int64_t)(capacity - used) * array_element_size(entry->array);
+        if (capacity <= used * MEMORY_WASTE_RATIO || unused < MEMORY_WASTE_MIN_BYTES)
+            continue;
+
+        print_asset_name(asset_row(array_asset(entry->array)));
+        printf(" %-18s at most %d of %d used, %.1f KB never used\n",
+               category_names[array_category(entry->array)], used, capacity, kilobytes(unused));
+    }
+    memory_unlock();
+}
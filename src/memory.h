@@ -0,0 +1,46 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdbool.h>
+
+// What the bytes are for, every dynamic array counts as other until it is tagged
+typedef enum {
+    MEMORY_OTHER,
+    MEMORY_VERTICES,         // positions of every level and the per mesh view space copies
+    MEMORY_FACES,            // faces, their planes and edges, and the per mesh face scratch
+    MEMORY_RASTER_TRIANGLES, // setup records handed from update to render
+    MEMORY_TEXTURES,
+    MEMORY_COLOR_BUFFER, // ours and the texture it is shown through
+    MEMORY_DEPTH_BUFFER, // w buffer, visibility depth and ids, and the occlusion buffer
+    NUM_MEMORY_CATEGORIES
+} memory_category_e;
+
+#define MEMORY_NO_ASSET -1     // owned by the renderer itself, not by any model
+#define MEMORY_MAX_ASSETS 64   // models past this are counted as no asset
+#define MEMORY_MAX_TRACKED 4096 // tagged arrays looked at for wasted capacity, the rest aren't
+#define MEMORY_WASTE_RATIO 2    // capacity over the most it held past which an array is wasteful
+#define MEMORY_WASTE_MIN_BYTES (64 * 1024) // anything smaller isn't worth reporting
+
+// Bytes allocated or, when negative, freed outside of the dynamic arrays. Safe from any thread
+void memory_add(memory_category_e category, int asset, long long bytes);
+
+// Shown in the report instead of the asset's index
+void memory_name_asset(int asset, const char *name);
+
+// Live and peak bytes per category and per asset, then every tagged array holding far more than
+// it ever used, so arrays emptied every frame aren't reported for being empty. Peaks are of each
+// row on its own, they don't have to have happened at the same time
+void memory_report(void);
+
+// Only for array.c, the registry of tagged arrays, all but memory_slot_shrink with memory_lock
+// held. memory_track returns the slot or -1 if it is full, the array is still counted by its tag
+int memory_track(void *array);
+void memory_retrack(int slot, void *array);
+void memory_untrack(int slot);
+// The size the array had before it shrinks, the most it ever held is the largest of these
+void memory_slot_shrink(int slot, int size);
+// Held around anything that moves a tracked array, so the report never reads a freed one
+void memory_lock(void);
+void memory_unlock(void);
+
+#endif
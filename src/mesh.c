@@ -1,97 +1,210 @@
 #include "mesh.h"
 
 #include "array.h"
+#include "lod.h"
+#include "memory.h"
+#include "obj.h"
 #include "texture.h"
+#include "trace.h"
+#include "vertex_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-static void load_obj_file_data(mesh_t *mesh, const char *file_name) {
-    FILE *obj_file = fopen(file_name, "r");
+// Face planes never change in model space, so only compute them once
+static void compute_face_planes(mesh_lod_t *lod) {
+    int num_faces = array_size(lod->faces);
+    vec3_soa_hold(&lod->face_normals, num_faces);
+    lod->face_offsets = array_hold(lod->face_offsets, num_faces, sizeof(float));
 
-    if (obj_file == NULL) {
-        fprintf(stderr, "Error opening .obj file");
-        return;
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t points[3] = {
+            lod->vertices[lod->faces[i].a],
+            lod->vertices[lod->faces[i].b],
+            lod->vertices[lod->faces[i].c],
+        };
+        vec3_t normal = triangle_normal(points);
+
+        // degenerate faces keep a zero normal, which always passes the backface test
+        if (vec3_length(normal) > 0.0f)
+            vec3_normalize(&normal);
+
+        lod->face_normals.x[i] = normal.x;
+        lod->face_normals.y[i] = normal.y;
+        lod->face_normals.z[i] = normal.z;
+        lod->face_offsets[i] = vec3_dot(normal, points[0]);
     }
+}
 
-    char line[512];
-
-    tex2_t *texcoords = NULL; // dynamic array
-
-    while (fgets(line, 512, obj_file)) {
-        // Vertices
-        if (line[0] == 'v' && line[1] == ' ') {
-            vec3_t obj_vertex;
-            if (!sscanf(line, "v %f %f %f", &obj_vertex.x, &obj_vertex.y, &obj_vertex.z)) {
-                fprintf(stderr, "Error reading vertex data .obj file");
-            }
-            array_push(mesh->vertices, obj_vertex);
-        } else if (line[0] == 'v' && line[1] == 't') {
-            tex2_t coord;
-            if (!sscanf(line, "vt %f %f", &coord.u, &coord.v)) {
-                fprintf(stderr, "Error reading vertex texture coordinate data .obj file");
-            }
-            // adjust because .obj files have an inverted v compared to the renderer
-            coord.v = 1 - coord.v;
-            array_push(texcoords, coord);
-        }
-        // Faces
-        else if (line[0] == 'f' && line[1] == ' ') {
-            int vertex_indices[3];
-            int texture_indices[3];
-            int normal_indices[3];
-
-            // Temporary fix for models without normals
-            /*sscanf(line, "f %d/%d %d/%d %d/%d ",
-                &vertex_indices[0], &texture_indices[0],
-                &vertex_indices[1], &texture_indices[1],
-                &vertex_indices[2], &texture_indices[2]
-                );*/
-
-            if (!sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d ", &vertex_indices[0],
-                        &texture_indices[0], &normal_indices[0], &vertex_indices[1],
-                        &texture_indices[1], &normal_indices[1], &vertex_indices[2],
-                        &texture_indices[2], &normal_indices[2])) {
-                fprintf(stderr, "Error reading vertex indice data from .obj file");
-            }
-
-            face_t obj_face = {
-                .a = vertex_indices[0] - 1, // adjust by 1, indices start at 1 in .obj format
-                .b = vertex_indices[1] - 1,
-                .c = vertex_indices[2] - 1,
-                .a_uv = texcoords[texture_indices[0] - 1],
-                .b_uv = texcoords[texture_indices[1] - 1],
-                .c_uv = texcoords[texture_indices[2] - 1],
-                .color = WHITE,
-            };
-            array_push(mesh->faces, obj_face);
+// Everything a level needs on top of its vertices and faces
+static void lod_init(mesh_lod_t *lod, int asset) {
+    // Faces come in whatever order the exporter or the simplifier left them, fetching their
+    // vertices jumps all over memory
+    int num_vertices = array_size(lod->vertices);
+    lod->loaded_locality = vertex_cache_measure(lod->faces, num_vertices);
+    TRACE_BEGIN("vertex_cache_optimize");
+    vertex_cache_optimize(lod->vertices, lod->faces);
+    TRACE_END();
+    lod->locality = vertex_cache_measure(lod->faces, num_vertices);
+
+    compute_face_planes(lod);
+
+    // Batch transforms want one array per component
+    vec3_soa_hold(&lod->positions, num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        lod->positions.x[i] = lod->vertices[i].x;
+        lod->positions.y[i] = lod->vertices[i].y;
+        lod->positions.z[i] = lod->vertices[i].z;
+    }
+
+    // shared edges are only drawn once in the wire modes
+    wireframe_build_edges(&lod->edges, lod->faces);
+
+    array_tag(lod->vertices, MEMORY_VERTICES, asset);
+    vec3_soa_tag(&lod->positions, MEMORY_VERTICES, asset);
+    array_tag(lod->faces, MEMORY_FACES, asset);
+    vec3_soa_tag(&lod->face_normals, MEMORY_FACES, asset);
+    array_tag(lod->face_offsets, MEMORY_FACES, asset);
+    array_tag(lod->edges, MEMORY_FACES, asset);
+}
+
+static void lod_free(mesh_lod_t *lod) {
+    array_free(lod->vertices);
+    array_free(lod->faces);
+    vec3_soa_free(&lod->positions);
+    vec3_soa_free(&lod->face_normals);
+    array_free(lod->face_offsets);
+    array_free(lod->edges);
+
+    memset(lod, 0, sizeof(mesh_lod_t));
+}
+
+bool model_load_geometry(model_t *model, const char *obj_file_name) {
+    mesh_lod_t *full = &model->lods[0];
+    TRACE_BEGIN("load_obj_file_data");
+    bool loaded = load_obj_file_data(obj_file_name, &full->vertices, &full->faces);
+    TRACE_END();
+    if (!loaded || array_size(full->faces) == 0) {
+        lod_free(full);
+        return false;
+    }
+    lod_init(full, model->asset);
+    model->num_lods = 1;
+
+    // Each level a quarter of the faces, so halving the size on screen keeps the faces per pixel
+    // about the same
+    while (model->num_lods < MESH_MAX_LODS) {
+        const mesh_lod_t *previous = &model->lods[model->num_lods - 1];
+        int target_faces = array_size(previous->faces) / 4;
+        if (target_faces < MESH_LOD_MIN_FACES)
+            break;
+
+        // Open borders and seams can stop it early, not worth a level if it barely shrank
+        mesh_lod_t *lod = &model->lods[model->num_lods];
+        TRACE_BEGIN_ID("lod_simplify", model->num_lods);
+        bool simplified = lod_simplify(previous->vertices, previous->faces, target_faces,
+                                       &lod->vertices, &lod->faces);
+        TRACE_END();
+        if (!simplified || array_size(lod->faces) > array_size(previous->faces) * 3 / 4) {
+            lod_free(lod);
+            break;
         }
+
+        lod_init(lod, model->asset);
+        model->num_lods++;
+    }
+
+    int num_vertices = array_size(full->vertices);
+    model->bounds = aabb_empty();
+    for (int i = 0; i < num_vertices; i++) {
+        model->bounds = aabb_add_point(model->bounds, full->vertices[i]);
     }
-    array_free(texcoords);
-    fclose(obj_file);
+    return true;
+}
+
+void model_free(model_t *model) {
+    for (int i = 0; i < model->num_lods; i++) {
+        lod_free(&model->lods[i]);
+    }
+    if (texture_loaded(&model->texture))
+        memory_add(MEMORY_TEXTURES, model->asset, -texture_bytes(&model->texture));
+    texture_free(&model->texture);
+
+    memset(model, 0, sizeof(model_t));
 }
 
-void mesh_init(mesh_t *mesh, const char *obj_file_name, const char *png_file_name, vec3_t rotation,
-               vec3_t scale, vec3_t translation) {
-    mesh->rotation = rotation;
-    mesh->scale = scale;
-    mesh->translation = translation;
+void model_report_locality(const model_t *model, const char *name) {
+    for (int i = 0; i < model->num_lods; i++) {
+        const mesh_lod_t *lod = &model->lods[i];
+        printf("%s level %d, %d faces, acmr %.3f to %.3f, vertex line misses %.3f to %.3f\n",
+               name, i, array_size(lod->faces), lod->loaded_locality.acmr, lod->locality.acmr,
+               lod->loaded_locality.line_misses, lod->locality.line_misses);
+    }
+}
 
-    load_obj_file_data(mesh, obj_file_name);
-    load_png_texture_data(&mesh->texture, png_file_name);
+void mesh_init(mesh_t *mesh, const model_t *model) {
+    // The first level is the biggest, scratch sized for it fits every other one
+    const mesh_lod_t *full = &model->lods[0];
+    int num_vertices = array_size(full->vertices);
+    int num_faces = array_size(full->faces);
+    vec3_soa_hold(&mesh->view_positions, num_vertices);
+    mesh->face_distances = array_hold(mesh->face_distances, num_faces, sizeof(float));
+    mesh->front_faces = array_hold(mesh->front_faces, num_faces, sizeof(uint8_t));
 
-    int num_faces = array_size(mesh->faces);
     // we'll allocate an array of all the faces in a mesh, most likely it won't need it all but just
     // to be safe it should create a bit of a buffer from reallocating if we make new triangles when
     // clipping
-    mesh->raster_tris = array_hold(mesh->raster_tris, num_faces, sizeof(triangle_t));
+    mesh->raster_tris = array_hold_aligned(mesh->raster_tris, num_faces, sizeof(triangle_setup_t));
+    wireframe_init(&mesh->wire, num_vertices);
+
+    // Per mesh, but only there because of the model
+    vec3_soa_tag(&mesh->view_positions, MEMORY_VERTICES, model->asset);
+    array_tag(mesh->face_distances, MEMORY_FACES, model->asset);
+    array_tag(mesh->front_faces, MEMORY_FACES, model->asset);
+    array_tag_aligned(mesh->raster_tris, MEMORY_RASTER_TRIANGLES, model->asset);
+}
+
+// Screen size below which level is used, every level halves it
+static float lod_threshold(int level) { return MESH_LOD_PIXELS / (1 << (level - 1)); }
+
+void mesh_select_lod(mesh_t *mesh, const model_t *model, float screen_size) {
+    int level = mesh->lod < model->num_lods ? mesh->lod : model->num_lods - 1;
+
+    while (level > 0 && screen_size > lod_threshold(level) * (1.0f + MESH_LOD_HYSTERESIS))
+        level--;
+    while (level < model->num_lods - 1 &&
+           screen_size < lod_threshold(level + 1) * (1.0f - MESH_LOD_HYSTERESIS))
+        level++;
+
+    mesh->lod = level;
+}
+
+void mesh_update_front_faces(mesh_t *mesh, const model_t *model,
+                             const mat4_t *inverse_world_matrix, bool mirrored,
+                             vec3_t camera_position) {
+    const mesh_lod_t *lod = &model->lods[mesh->lod];
+
+    // Move the camera into model space once instead of every vertex into view space
+    vec3_t eye = vec4_to_vec3(mat4_mul_vec4(inverse_world_matrix, vec3_to_vec4(camera_position)));
+
+    // Mirroring transforms flip the winding, and so which side of the plane is the front
+    float side = mirrored ? -1.0f : 1.0f;
+
+    int num_faces = array_size(lod->faces);
+    vec3_dot_soa(lod->face_normals, eye, mesh->face_distances, num_faces);
+    for (int i = 0; i < num_faces; i++) {
+        float distance = mesh->face_distances[i] - lod->face_offsets[i];
+        mesh->front_faces[i] = side * distance >= 0.0f;
+    }
 }
 
 void mesh_free(mesh_t *mesh) {
-    array_free(mesh->vertices);
-    array_free(mesh->faces);
-    texture_free(&mesh->texture);
-    array_free(mesh->raster_tris);
+    vec3_soa_free(&mesh->view_positions);
+    array_free(mesh->face_distances);
+    array_free(mesh->front_faces);
+    wireframe_free(&mesh->wire);
+    array_free_aligned(mesh->raster_tris);
 
     memset(mesh, 0, sizeof(mesh_t));
 }
@@ -1,24 +1,85 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <stdint.h>
+
+#include "bvh.h"
+#include "matrix.h"
 #include "texture.h"
 #include "triangle.h"
 #include "vector.h"
+#include "vertex_cache.h"
+#include "wireframe.h"
 
 #define N_CUBE_VERTICES 8
 #define N_CUBE_FACES (6 * 2)
 
-// Dynamic size mesh
+#define MESH_MAX_LODS 4
+#define MESH_LOD_MIN_FACES 64    // stop simplifying below this many faces
+#define MESH_LOD_PIXELS 300.0f   // screen size below which the first simplified level is used
+#define MESH_LOD_HYSTERESIS 0.1f // how far past a threshold the size has to go to switch levels
+
+// Geometry of one level of detail, level 0 is the mesh as loaded, every level after has about a
+// quarter of the faces of the one before
+typedef struct {
+    vec3_t *vertices;        // dynamic array of vertices
+    vec3_soa_t positions;    // same vertices as structure of arrays, for the batch transforms
+    face_t *faces;           // dynamic array of faces
+    vec3_soa_t face_normals; // unit normal of every face in model space
+    float *face_offsets;     // dynamic array, plane offset of every face, dot(normal, a)
+    edge_t *edges;           // dynamic array of unique edges for the wire modes
+
+    // Vertex reuse of the faces in the order they were loaded or simplified in, then once
+    // reordered for it
+    vertex_cache_locality_t loaded_locality;
+    vertex_cache_locality_t locality;
+} mesh_lod_t;
+
+// Everything loaded from one obj and png pair, read only once loaded and shared by every mesh
+// drawing it
 typedef struct {
-    vec3_t rotation, scale, translation;
-    vec3_t *vertices; // dynamic array of vertices
-    face_t *faces;    // dynamic array of faces
+    mesh_lod_t lods[MESH_MAX_LODS];
+    int num_lods;  // 0 until loaded
+    aabb_t bounds; // model space bounds of all the vertices
     texture_t texture;
-    triangle_t *raster_tris; // dynamic array of triangles to rasterize, should start as zero
+    int asset; // index in the scene file, what its memory is counted under
+} model_t;
+
+// One instance of a model in the scene, with its own transform and per-frame scratch
+typedef struct {
+    int node;                  // index of the transform node in the scene graph
+    int model;                 // index of the model in the scene
+    int lod;                   // level picked this frame
+    bool occluder;             // always drawn into the occlusion buffer when visible
+    vec3_soa_t view_positions; // every vertex of the current level in view space
+    float *face_distances;     // dynamic array, scratch for the backface test
+    uint8_t *front_faces;      // dynamic array, every face's backface test result for this frame
+    wireframe_t wire;          // per-frame lines and points for the wire modes
+    triangle_setup_t *raster_tris; // aligned dynamic array of triangles to rasterize
 } mesh_t;
 
-void mesh_init(mesh_t *mesh, const char *obj_file_name, const char *png_file_name, vec3_t rotation,
-               vec3_t scale, vec3_t translation);
+// Loads the obj and builds the chain of simplified levels, can run on any thread. Leaves the
+// texture alone, so it can be decoded into the same model on another thread at the same time.
+// Returns false if the obj could not be read or has no faces
+bool model_load_geometry(model_t *model, const char *obj_file_name);
+
+void model_free(model_t *model);
+
+// One line per level, how well its faces reuse vertices as loaded and once reordered
+void model_report_locality(const model_t *model, const char *name);
+
+// Sizes the mesh's scratch for its model, once the model has loaded
+void mesh_init(mesh_t *mesh, const model_t *model);
+
+// Picks the level for a mesh covering screen_size pixels, only moves to another level once the
+// size is clearly past the threshold so meshes sitting right on one do not flicker between two
+void mesh_select_lod(mesh_t *mesh, const model_t *model, float screen_size);
+
+// Backface test for every face of the current level done in model space, so faces looking away
+// are rejected before any of their vertices are transformed, fills mesh->front_faces
+void mesh_update_front_faces(mesh_t *mesh, const model_t *model,
+                             const mat4_t *inverse_world_matrix, bool mirrored,
+                             vec3_t camera_position);
 
 void mesh_free(mesh_t *mesh);
 
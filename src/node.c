@@ -0,0 +1,96 @@
+#include "node.h"
+
+#include "array.h"
+
+int node_add(node_t **nodes, int parent, vec3_t rotation, vec3_t scale, vec3_t translation) {
+    node_t node = {
+        .rotation = rotation,
+        .scale = scale,
+        .translation = translation,
+        .parent = parent,
+        .first_child = -1,
+        .next_sibling = -1,
+        .local_dirty = true,
+        .world_dirty = true,
+        .view_version = -1,
+    };
+
+    int index = array_size(*nodes);
+    if (parent >= 0) {
+        // push to the front of the parent's children
+        node.next_sibling = (*nodes)[parent].first_child;
+        (*nodes)[parent].first_child = index;
+    }
+
+    array_push(*nodes, node);
+    return index;
+}
+
+static void mark_world_dirty(node_t *nodes, int node) {
+    nodes[node].world_dirty = true;
+    for (int child = nodes[node].first_child; child != -1; child = nodes[child].next_sibling) {
+        mark_world_dirty(nodes, child);
+    }
+}
+
+void node_set_transform(node_t *nodes, int node, vec3_t rotation, vec3_t scale,
+                        vec3_t translation) {
+    nodes[node].rotation = rotation;
+    nodes[node].scale = scale;
+    nodes[node].translation = translation;
+    nodes[node].local_dirty = true;
+    mark_world_dirty(nodes, node);
+}
+
+static mat4_t make_local_matrix(const node_t *node) {
+    mat4_t scale_matrix = mat4_make_scale(node->scale.x, node->scale.y, node->scale.z);
+    mat4_t rotation_matrix_x = mat4_make_rotation_x(node->rotation.x);
+    mat4_t rotation_matrix_y = mat4_make_rotation_y(node->rotation.y);
+    mat4_t rotation_matrix_z = mat4_make_rotation_z(node->rotation.z);
+    mat4_t translation_matrix =
+        mat4_make_translation(node->translation.x, node->translation.y, node->translation.z);
+
+    // Combine all transforms, scale, rotate, translate, in that order
+    mat4_t local_matrix = scale_matrix;
+    local_matrix = mat4_mul_mat4(&rotation_matrix_z, &local_matrix);
+    local_matrix = mat4_mul_mat4(&rotation_matrix_y, &local_matrix);
+    local_matrix = mat4_mul_mat4(&rotation_matrix_x, &local_matrix);
+    local_matrix = mat4_mul_mat4(&translation_matrix, &local_matrix);
+
+    return local_matrix;
+}
+
+int nodes_update(node_t *nodes, const mat4_t *view_matrix, int view_version) {
+    int num_moved = 0;
+    int num_nodes = array_size(nodes);
+    for (int i = 0; i < num_nodes; i++) {
+        node_t *node = &nodes[i];
+
+        if (node->local_dirty) {
+            node->local_matrix = make_local_matrix(node);
+            node->local_dirty = false;
+        }
+
+        // Parents come first, so theirs is already up to date
+        if (node->world_dirty) {
+            if (node->parent < 0)
+                node->world_matrix = node->local_matrix;
+            else
+                node->world_matrix =
+                    mat4_mul_mat4(&nodes[node->parent].world_matrix, &node->local_matrix);
+
+            node->inverse_world_matrix = mat4_inverse(&node->world_matrix);
+            node->mirrored = mat4_determinant(&node->world_matrix) < 0.0f;
+            node->world_dirty = false;
+            node->view_version = -1;
+            num_moved++;
+        }
+
+        if (node->view_version != view_version) {
+            node->model_view_matrix = mat4_mul_mat4(view_matrix, &node->world_matrix);
+            node->view_version = view_version;
+        }
+    }
+
+    return num_moved;
+}
@@ -0,0 +1,38 @@
+#ifndef NODE_H
+#define NODE_H
+
+#include <stdbool.h>
+
+#include "matrix.h"
+#include "vector.h"
+
+// Transform node in the scene graph, nodes live in one dynamic array and refer to each other by
+// index, a parent is always added before its children so one pass in order updates everything
+typedef struct {
+    vec3_t rotation, scale, translation; // local, relative to the parent
+    int parent;                          // -1 for roots
+    int first_child, next_sibling;       // -1 terminated
+
+    bool local_dirty; // local transform changed since local_matrix was built
+    bool world_dirty; // this node or one of its parents changed since world_matrix was built
+    int view_version; // version of the view matrix model_view_matrix was built with
+
+    mat4_t local_matrix;
+    mat4_t world_matrix;
+    mat4_t inverse_world_matrix;
+    mat4_t model_view_matrix;
+    bool mirrored; // world matrix has a negative determinant, flips triangle winding
+} node_t;
+
+// Returns the index of the new node, parent is -1 for a root
+int node_add(node_t **nodes, int parent, vec3_t rotation, vec3_t scale, vec3_t translation);
+
+// Marks the node and everything below it dirty
+void node_set_transform(node_t *nodes, int node, vec3_t rotation, vec3_t scale,
+                        vec3_t translation);
+
+// Rebuilds world matrices of dirty nodes, and model-view matrices of nodes that changed or were
+// built with an older view_version, returns how many world matrices were rebuilt
+int nodes_update(node_t *nodes, const mat4_t *view_matrix, int view_version);
+
+#endif
@@ -0,0 +1,471 @@
+#include "obj.h"
+
+#include <SDL2/SDL.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+// vt index of corners that don't have one
+#define OBJ_NO_INDEX INT_MIN
+
+// Corner index flags, relative indices can only be resolved once every chunk has been counted
+#define OBJ_V_RELATIVE (1 << 0)
+#define OBJ_VT_RELATIVE (1 << 1)
+
+// One face corner as read from the file, relative indices are stored as chunk-local indices,
+// which may be negative when they point back into a previous chunk
+typedef struct {
+    int v, vt;
+    int flags;
+} obj_corner_t;
+
+typedef struct {
+    const char *begin, *end; // [begin, end) always ends right after a '\n'
+
+    vec3_t *vertices;       // dynamic array
+    tex2_t *texcoords;      // dynamic array
+    obj_corner_t *corners;  // dynamic array, 3 per triangle
+    obj_corner_t *polygon;  // dynamic array, scratch for the face being parsed
+    int num_bad_faces;
+
+    // Filled in once every chunk is parsed, for turning corners into faces
+    int vertex_start, texcoord_start; // where this chunk's data starts in the file
+    int num_file_vertices, num_file_texcoords;
+    int base_vertex;                  // vertices already in the array before this file
+    const tex2_t *file_texcoords;
+    face_t *faces; // output, written contiguously from here
+    int num_faces;
+} obj_chunk_t;
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_blank(char c) { return c == ' ' || c == '\t'; }
+static bool is_line_end(char c) { return c == '\n' || c == '\r' || c == '#' || c == '\0'; }
+
+static const char *skip_blanks(const char *p) {
+    while (is_blank(*p))
+        p++;
+    return p;
+}
+
+// Buffer always ends in a '\n', so this can't run off the end
+static const char *skip_line(const char *p) {
+    while (*p != '\n')
+        p++;
+    return p + 1;
+}
+
+static const double powers_of_10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Hand rolled decimal parser, accumulate up to 19 significant digits in an integer and scale by
+// an exact power of ten, anything without digits (nan, inf) falls back to strtof.
+// Returns the end of the number or NULL if there was none
+static const char *parse_float(const char *p, float *out) {
+    const char *start = p;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+')
+        p++;
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int num_digits = 0;
+    bool any_digits = false;
+
+    for (; is_digit(*p); p++) {
+        any_digits = true;
+        if (num_digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            num_digits += mantissa != 0; // leading zeros aren't significant
+        } else {
+            exponent++;
+        }
+    }
+
+    if (*p == '.') {
+        p++;
+        for (; is_digit(*p); p++) {
+            any_digits = true;
+            if (num_digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                num_digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!any_digits) {
+        char *end;
+        *out = strtof(start, &end);
+        return end == start ? NULL : end;
+    }
+
+    if (*p == 'e' || *p == 'E') {
+        const char *e = p + 1;
+        bool negative_exponent = *e == '-';
+        if (*e == '-' || *e == '+')
+            e++;
+
+        if (is_digit(*e)) {
+            int value = 0;
+            for (; is_digit(*e); e++) {
+                if (value < 10000)
+                    value = value * 10 + (*e - '0');
+            }
+            exponent += negative_exponent ? -value : value;
+            p = e;
+        }
+    }
+
+    double value = (double)mantissa;
+    if (exponent < 0)
+        value = exponent >= -22 ? value / powers_of_10[-exponent] : value * pow(10.0, exponent);
+    else if (exponent > 0)
+        value = exponent <= 22 ? value * powers_of_10[exponent] : value * pow(10.0, exponent);
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+// Returns the end of the number or NULL if there was none
+static const char *parse_int(const char *p, int *out) {
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+')
+        p++;
+
+    if (!is_digit(*p))
+        return NULL;
+
+    long long value = 0;
+    for (; is_digit(*p); p++) {
+        if (value <= INT_MAX)
+            value = value * 10 + (*p - '0');
+    }
+    if (value > INT_MAX)
+        value = INT_MAX;
+
+    *out = (int)(negative ? -value : value);
+    return p;
+}
+
+// Parses up to count floats, at least min_count must be there, missing ones are left untouched
+static bool parse_floats(const char *p, float *out, int min_count, int count) {
+    for (int i = 0; i < count; i++) {
+        p = skip_blanks(p);
+        if (i >= min_count && is_line_end(*p))
+            return true;
+
+        p = parse_float(p, &out[i]);
+        if (p == NULL)
+            return false;
+    }
+    return true;
+}
+
+// .obj indices start at 1, negative ones count back from the last element read so far
+static bool resolve_index(int index, int local_count, int *out, bool *relative) {
+    if (index > 0) {
+        *out = index - 1;
+        *relative = false;
+    } else if (index < 0) {
+        *out = local_count + index;
+        *relative = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// f v, f v/vt, f v//vn, f v/vt/vn with any number of corners, fan triangulated
+static bool parse_face(obj_chunk_t *chunk, const char *p) {
+    array_reset(chunk->polygon);
+
+    while (true) {
+        p = skip_blanks(p);
+        if (is_line_end(*p))
+            break;
+
+        obj_corner_t corner = {.vt = OBJ_NO_INDEX};
+        bool relative;
+        int index;
+
+        p = parse_int(p, &index);
+        if (p == NULL || !resolve_index(index, array_size(chunk->vertices), &corner.v, &relative))
+            return false;
+        corner.flags |= relative ? OBJ_V_RELATIVE : 0;
+
+        if (*p == '/') {
+            p++;
+            if (*p != '/') {
+                p = parse_int(p, &index);
+                if (p == NULL ||
+                    !resolve_index(index, array_size(chunk->texcoords), &corner.vt, &relative))
+                    return false;
+                corner.flags |= relative ? OBJ_VT_RELATIVE : 0;
+            }
+
+            // Normals are read for validation only, faces are flat shaded
+            if (*p == '/') {
+                p = parse_int(p + 1, &index);
+                if (p == NULL || index == 0)
+                    return false;
+            }
+        }
+
+        if (!is_blank(*p) && !is_line_end(*p))
+            return false;
+
+        array_push(chunk->polygon, corner);
+    }
+
+    int num_corners = array_size(chunk->polygon);
+    if (num_corners < 3)
+        return false;
+
+    for (int i = 1; i < num_corners - 1; i++) {
+        array_push(chunk->corners, chunk->polygon[0]);
+        array_push(chunk->corners, chunk->polygon[i]);
+        array_push(chunk->corners, chunk->polygon[i + 1]);
+    }
+    return true;
+}
+
+static int parse_chunk(void *data) {
+    obj_chunk_t *chunk = (obj_chunk_t *)data;
+
+    const char *p = chunk->begin;
+    while (p < chunk->end) {
+        const char *line = skip_blanks(p);
+
+        // Vertices
+        if (line[0] == 'v' && is_blank(line[1])) {
+            vec3_t vertex = {0};
+            if (!parse_floats(line + 2, &vertex.x, 3, 3))
+                fprintf(stderr, "Error reading vertex data .obj file\n");
+
+            // pushed even when malformed so later indices still line up
+            array_push(chunk->vertices, vertex);
+        }
+        // Texture coordinates, v is optional
+        else if (line[0] == 'v' && line[1] == 't' && is_blank(line[2])) {
+            tex2_t coord = {0};
+            if (!parse_floats(line + 3, &coord.u, 1, 2))
+                fprintf(stderr, "Error reading vertex texture coordinate data .obj file\n");
+
+            // adjust because .obj files have an inverted v compared to the renderer, pushed even
+            // when malformed so later indices still line up
+            coord.v = 1 - coord.v;
+            array_push(chunk->texcoords, coord);
+        }
+        // Faces
+        else if (line[0] == 'f' && is_blank(line[1])) {
+            if (!parse_face(chunk, line + 2))
+                chunk->num_bad_faces++;
+        }
+
+        p = skip_line(line);
+    }
+
+    return 0;
+}
+
+// Turn a corner index into a file wide one, false if it doesn't point at anything
+static bool file_index(int index, bool relative, int chunk_start, int file_count, int *out) {
+    *out = relative ? chunk_start + index : index;
+    return *out >= 0 && *out < file_count;
+}
+
+static int build_chunk_faces(void *data) {
+    obj_chunk_t *chunk = (obj_chunk_t *)data;
+
+    int num_triangles = array_size(chunk->corners) / 3;
+    for (int i = 0; i < num_triangles; i++) {
+        const obj_corner_t *corners = &chunk->corners[i * 3];
+
+        int v[3];
+        tex2_t uv[3] = {{0}};
+        bool valid = true;
+        for (int j = 0; j < 3 && valid; j++) {
+            valid = file_index(corners[j].v, corners[j].flags & OBJ_V_RELATIVE,
+                               chunk->vertex_start, chunk->num_file_vertices, &v[j]);
+
+            if (valid && corners[j].vt != OBJ_NO_INDEX) {
+                int vt;
+                valid = file_index(corners[j].vt, corners[j].flags & OBJ_VT_RELATIVE,
+                                   chunk->texcoord_start, chunk->num_file_texcoords, &vt);
+                if (valid)
+                    uv[j] = chunk->file_texcoords[vt];
+            }
+        }
+
+        if (!valid) {
+            chunk->num_bad_faces++;
+            continue;
+        }
+
+        face_t face = {
+            .a = chunk->base_vertex + v[0],
+            .b = chunk->base_vertex + v[1],
+            .c = chunk->base_vertex + v[2],
+            .a_uv = uv[0],
+            .b_uv = uv[1],
+            .c_uv = uv[2],
+            .color = WHITE,
+        };
+        chunk->faces[chunk->num_faces++] = face;
+    }
+
+    return 0;
+}
+
+// Runs function over every chunk, the calling thread takes the first one itself
+static void run_chunks(obj_chunk_t *chunks, int num_chunks, SDL_ThreadFunction function) {
+    SDL_Thread *threads[OBJ_MAX_THREADS] = {0};
+
+    for (int i = 1; i < num_chunks; i++) {
+        threads[i] = SDL_CreateThread(function, "obj_parse", &chunks[i]);
+    }
+
+    function(&chunks[0]);
+
+    for (int i = 1; i < num_chunks; i++) {
+        // Couldn't get a thread, just do it here
+        if (threads[i] == NULL)
+            function(&chunks[i]);
+        else
+            SDL_WaitThread(threads[i], NULL);
+    }
+}
+
+// Whole file in one block, with a '\n' sentinel appended so every line ends in one
+static char *read_whole_file(const char *file_name, size_t *size) {
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = file_size >= 0 ? (char *)malloc(file_size + 2) : NULL;
+    if (data == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t bytes_read = fread(data, 1, file_size, file);
+    fclose(file);
+
+    data[bytes_read] = '\n';
+    data[bytes_read + 1] = '\0';
+    *size = bytes_read + 1;
+
+    return data;
+}
+
+bool load_obj_file_data(const char *file_name, vec3_t **vertices, face_t **faces) {
+    size_t size;
+    char *data = read_whole_file(file_name, &size);
+    if (data == NULL) {
+        fprintf(stderr, "Error opening .obj file %s\n", file_name);
+        return false;
+    }
+
+    int num_chunks = 1;
+    if (size >= OBJ_PARALLEL_MIN_BYTES) {
+        num_chunks = SDL_GetCPUCount();
+        if (num_chunks < 1)
+            num_chunks = 1;
+        if (num_chunks > OBJ_MAX_THREADS)
+            num_chunks = OBJ_MAX_THREADS;
+    }
+
+    // Split at line boundaries
+    obj_chunk_t chunks[OBJ_MAX_THREADS] = {{0}};
+    const char *chunk_begin = data;
+    for (int i = 0; i < num_chunks; i++) {
+        const char *chunk_end = data + size;
+        if (i < num_chunks - 1) {
+            chunk_end = data + (size * (i + 1)) / num_chunks;
+            if (chunk_end < chunk_begin)
+                chunk_end = chunk_begin;
+            while (chunk_end < data + size && chunk_end[-1] != '\n')
+                chunk_end++;
+        }
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    run_chunks(chunks, num_chunks, parse_chunk);
+
+    // Every chunk's counts are known now, so we know where each one's data goes in the file
+    int num_file_vertices = 0, num_file_texcoords = 0, num_triangles = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].vertex_start = num_file_vertices;
+        chunks[i].texcoord_start = num_file_texcoords;
+        num_file_vertices += array_size(chunks[i].vertices);
+        num_file_texcoords += array_size(chunks[i].texcoords);
+        num_triangles += array_size(chunks[i].corners) / 3;
+    }
+
+    int base_vertex = array_size(*vertices);
+    *vertices = array_hold(*vertices, num_file_vertices, sizeof(vec3_t));
+
+    tex2_t *file_texcoords = NULL; // dynamic array
+    file_texcoords = array_hold(file_texcoords, num_file_texcoords, sizeof(tex2_t));
+
+    for (int i = 0; i < num_chunks; i++) {
+        if (chunks[i].vertices != NULL)
+            memcpy(*vertices + base_vertex + chunks[i].vertex_start, chunks[i].vertices,
+                   array_size(chunks[i].vertices) * sizeof(vec3_t));
+        if (chunks[i].texcoords != NULL)
+            memcpy(file_texcoords + chunks[i].texcoord_start, chunks[i].texcoords,
+                   array_size(chunks[i].texcoords) * sizeof(tex2_t));
+    }
+
+    int base_face = array_size(*faces);
+    *faces = array_hold(*faces, num_triangles, sizeof(face_t));
+
+    int face_start = base_face;
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].num_file_vertices = num_file_vertices;
+        chunks[i].num_file_texcoords = num_file_texcoords;
+        chunks[i].base_vertex = base_vertex;
+        chunks[i].file_texcoords = file_texcoords;
+        chunks[i].faces = *faces + face_start;
+        face_start += array_size(chunks[i].corners) / 3;
+    }
+
+    run_chunks(chunks, num_chunks, build_chunk_faces);
+
+    // Close the gaps left by skipped faces
+    int num_faces = base_face;
+    int num_bad_faces = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (chunks[i].num_faces > 0)
+            memmove(*faces + num_faces, chunks[i].faces, chunks[i].num_faces * sizeof(face_t));
+        num_faces += chunks[i].num_faces;
+        num_bad_faces += chunks[i].num_bad_faces;
+
+        array_free(chunks[i].vertices);
+        array_free(chunks[i].texcoords);
+        array_free(chunks[i].corners);
+        array_free(chunks[i].polygon);
+    }
+    array_truncate(*faces, num_faces);
+
+    if (num_bad_faces > 0)
+        fprintf(stderr, "Skipped %d malformed faces in .obj file %s\n", num_bad_faces, file_name);
+
+    array_free(file_texcoords);
+    free(data);
+
+    return true;
+}
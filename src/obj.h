@@ -0,0 +1,19 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <stdbool.h>
+
+#include "triangle.h"
+#include "vector.h"
+
+// Files bigger than this get split at line boundaries and parsed on multiple threads
+#define OBJ_PARALLEL_MIN_BYTES (4 * 1024 * 1024)
+#define OBJ_MAX_THREADS 16
+
+// Reads the whole .obj in one block and appends to the vertices and faces dynamic arrays.
+// Handles v, vt, vn, faces with any number of corners (fan triangulated) and every index form:
+// v, v/vt, v//vn, v/vt/vn, including negative (relative) indices. Faces without vt get zero uvs.
+// Returns false if the file could not be read, faces with bad indices are skipped and reported
+bool load_obj_file_data(const char *file_name, vec3_t **vertices, face_t **faces);
+
+#endif
@@ -0,0 +1,160 @@
+#include "occlusion.h"
+
+#include <math.h>
+
+#include "array.h"
+
+void occlusion_init(occlusion_t *occlusion) {
+    occlusion->depth =
+        array_hold(occlusion->depth, OCCLUSION_WIDTH * OCCLUSION_HEIGHT, sizeof(float));
+    array_tag(occlusion->depth, MEMORY_DEPTH_BUFFER, MEMORY_NO_ASSET);
+    occlusion_clear(occlusion);
+}
+
+void occlusion_clear(occlusion_t *occlusion) {
+    for (int i = 0; i < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; i++) {
+        occlusion->depth[i] = INFINITY;
+    }
+}
+
+// Twice the signed area of abc, positive on one side of ab and negative on the other
+static float edge_function(float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+static void draw_occluder_triangle(occlusion_t *occlusion, const float x[3], const float y[3],
+                                   float depth) {
+    float area = edge_function(x[0], y[0], x[1], y[1], x[2], y[2]);
+    if (area == 0.0f)
+        return;
+
+    // Either winding, both faces of an occluder block the view
+    int b = area > 0.0f ? 1 : 2;
+    int c = area > 0.0f ? 2 : 1;
+
+    int x_min = (int)floorf(fminf(x[0], fminf(x[1], x[2])));
+    int x_max = (int)ceilf(fmaxf(x[0], fmaxf(x[1], x[2])));
+    int y_min = (int)floorf(fminf(y[0], fminf(y[1], y[2])));
+    int y_max = (int)ceilf(fmaxf(y[0], fmaxf(y[1], y[2])));
+    x_min = x_min < 0 ? 0 : x_min;
+    y_min = y_min < 0 ? 0 : y_min;
+    x_max = x_max > OCCLUSION_WIDTH - 1 ? OCCLUSION_WIDTH - 1 : x_max;
+    y_max = y_max > OCCLUSION_HEIGHT - 1 ? OCCLUSION_HEIGHT - 1 : y_max;
+    if (x_min > x_max || y_min > y_max)
+        return;
+
+    // Edge functions at the first texel center, then stepped across the box
+    float px = x_min + 0.5f, py = y_min + 0.5f;
+    float w0_row = edge_function(x[b], y[b], x[c], y[c], px, py);
+    float w1_row = edge_function(x[c], y[c], x[0], y[0], px, py);
+    float w2_row = edge_function(x[0], y[0], x[b], y[b], px, py);
+
+    float w0_dx = -(y[c] - y[b]), w0_dy = x[c] - x[b];
+    float w1_dx = -(y[0] - y[c]), w1_dy = x[0] - x[c];
+    float w2_dx = -(y[b] - y[0]), w2_dy = x[b] - x[0];
+
+    for (int j = y_min; j <= y_max; j++) {
+        float w0 = w0_row, w1 = w1_row, w2 = w2_row;
+        float *row = &occlusion->depth[j * OCCLUSION_WIDTH];
+
+        for (int i = x_min; i <= x_max; i++) {
+            if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f && depth < row[i])
+                row[i] = depth;
+
+            w0 += w0_dx;
+            w1 += w1_dx;
+            w2 += w2_dx;
+        }
+
+        w0_row += w0_dy;
+        w1_row += w1_dy;
+        w2_row += w2_dy;
+    }
+}
+
+void occlusion_draw(occlusion_t *occlusion, vec3_soa_t view_verts, int num_vertices,
+                    const face_t *faces, const mat4_t *projection_matrix, float z_near) {
+    int held = array_size(occlusion->screen_verts.x);
+    if (held < num_vertices)
+        vec4_soa_hold(&occlusion->screen_verts, num_vertices - held);
+
+    vec4_soa_t screen = occlusion->screen_verts;
+    mat4_project_to_screen_soa(projection_matrix, view_verts, screen, OCCLUSION_WIDTH / 2.0f,
+                               OCCLUSION_HEIGHT / 2.0f, num_vertices);
+
+    int num_faces = array_size((void *)faces);
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3] = {faces[i].a, faces[i].b, faces[i].c};
+        float x[3], y[3], depth = 0.0f;
+        bool behind = false;
+
+        for (int j = 0; j < 3; j++) {
+            x[j] = screen.x[indices[j]];
+            y[j] = screen.y[indices[j]];
+            behind |= screen.w[indices[j]] < z_near;
+            depth = fmaxf(depth, screen.w[indices[j]]);
+        }
+
+        // Clipping would only make it occlude less, dropping it is still correct
+        if (behind)
+            continue;
+
+        // The farthest point, so nothing the triangle does not really hide fails the test
+        draw_occluder_triangle(occlusion, x, y, depth);
+    }
+}
+
+bool occlusion_test(const occlusion_t *occlusion, aabb_t bounds, const mat4_t *view_matrix,
+                    const mat4_t *projection_matrix, float z_near) {
+    float x_min = INFINITY, y_min = INFINITY, x_max = -INFINITY, y_max = -INFINITY;
+    float nearest = INFINITY;
+
+    for (int i = 0; i < 8; i++) {
+        vec4_t corner = {
+            i & 1 ? bounds.max.x : bounds.min.x,
+            i & 2 ? bounds.max.y : bounds.min.y,
+            i & 4 ? bounds.max.z : bounds.min.z,
+            1.0f,
+        };
+        corner = mat4_mul_vec4(view_matrix, corner);
+
+        // Reaches around the camera, can't be behind anything
+        if (corner.z < z_near)
+            return true;
+        nearest = fminf(nearest, corner.z);
+
+        vec4_t projected = mat4_mul_vec4_project(projection_matrix, corner);
+        float x = (projected.x + 1.0f) * (OCCLUSION_WIDTH / 2.0f);
+        float y = (1.0f - projected.y) * (OCCLUSION_HEIGHT / 2.0f);
+        x_min = fminf(x_min, x);
+        y_min = fminf(y_min, y);
+        x_max = fmaxf(x_max, x);
+        y_max = fmaxf(y_max, y);
+    }
+
+    // One texel of margin, occluder edges only count texels whose centers they cover
+    int x0 = (int)floorf(x_min) - 1, x1 = (int)ceilf(x_max) + 1;
+    int y0 = (int)floorf(y_min) - 1, y1 = (int)ceilf(y_max) + 1;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > OCCLUSION_WIDTH - 1 ? OCCLUSION_WIDTH - 1 : x1;
+    y1 = y1 > OCCLUSION_HEIGHT - 1 ? OCCLUSION_HEIGHT - 1 : y1;
+
+    // Not strictly in front, a mesh's own triangles are never nearer than its bounds, so occluders
+    // can be tested like everything else and only fail where something else covers them
+    for (int j = y0; j <= y1; j++) {
+        const float *row = &occlusion->depth[j * OCCLUSION_WIDTH];
+        for (int i = x0; i <= x1; i++) {
+            if (row[i] >= nearest)
+                return true;
+        }
+    }
+    return false;
+}
+
+void occlusion_free(occlusion_t *occlusion) {
+    array_free(occlusion->depth);
+    vec4_soa_free(&occlusion->screen_verts);
+    occlusion->depth = NULL;
+    occlusion->screen_verts = (vec4_soa_t){0};
+}
@@ -0,0 +1,39 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stdbool.h>
+
+#include "bvh.h"
+#include "matrix.h"
+#include "triangle.h"
+#include "vector.h"
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_MAX_OCCLUDERS 8
+#define OCCLUSION_MIN_SIZE 64.0f // meshes smaller than this many pixels on screen never occlude
+
+// Low resolution depth buffer of a few big meshes, anything whose bounds sit completely behind it
+// can skip the geometry stage. Conservative, every triangle writes its farthest depth
+typedef struct {
+    float *depth;            // dynamic array, view depth of the nearest occluder in every texel
+    vec4_soa_t screen_verts; // dynamic arrays, scratch for the occluder vertices
+} occlusion_t;
+
+void occlusion_init(occlusion_t *occlusion);
+
+// Start of the frame, nothing occludes anything
+void occlusion_clear(occlusion_t *occlusion);
+
+// Rasterize an occluder from its view space vertices, triangles reaching in front of z_near are
+// skipped rather than clipped
+void occlusion_draw(occlusion_t *occlusion, vec3_soa_t view_verts, int num_vertices,
+                    const face_t *faces, const mat4_t *projection_matrix, float z_near);
+
+// True if any part of the world space box might be in front of what has been drawn so far
+bool occlusion_test(const occlusion_t *occlusion, aabb_t bounds, const mat4_t *view_matrix,
+                    const mat4_t *projection_matrix, float z_near);
+
+void occlusion_free(occlusion_t *occlusion);
+
+#endif
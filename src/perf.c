@@ -0,0 +1,239 @@
+// syscall and ioctl are not part of c99
+#define _GNU_SOURCE
+
+#include "perf.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *const stage_names[NUM_PERF_STAGES] = {
+    "transform", "clip", "sort", "raster", "clear", "present",
+};
+
+static const char *const counter_names[NUM_PERF_COUNTERS] = {
+    "cycles", "instructions", "l1d misses", "llc misses", "branch misses",
+};
+
+// Per triangle for the stages that work on them, per pixel for the ones that go over the screen
+static const bool stage_per_pixel[NUM_PERF_STAGES] = {
+    [PERF_STAGE_CLEAR] = true,
+    [PERF_STAGE_PRESENT] = true,
+};
+
+typedef struct {
+    uint64_t counts[NUM_PERF_STAGES][NUM_PERF_COUNTERS];
+    uint64_t triangles, pixels;
+} perf_totals_t;
+
+static bool opened = false; // tried, whether it worked or not
+static bool available = false;
+static bool enabled = false;
+static int group = -1;                   // file of the cycle counter, which leads the rest
+static int fds[NUM_PERF_COUNTERS];       // -1 for counters that could not be opened, set on open
+static int slots[NUM_PERF_COUNTERS];     // where each counter sits in a group read
+static int num_open = 0;
+static uint64_t started[NUM_PERF_COUNTERS]; // values at the last perf_begin
+static perf_totals_t frame;
+static perf_totals_t total;
+static int num_frames = 0;
+
+#if defined(__linux__)
+static int open_counter(uint32_t type, uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1; // the whole group starts with its leader
+    attr.exclude_kernel = 1;        // allowed without privileges on most distributions
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+// Current value of every open counter, scaled up if the group had to share the hardware
+static bool read_counters(uint64_t values[NUM_PERF_COUNTERS]) {
+    uint64_t data[3 + NUM_PERF_COUNTERS]; // nr, time enabled, time running, then the values
+    if (read(group, data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return false;
+
+    double scale = data[2] > 0 && data[2] < data[1] ? (double)data[1] / data[2] : 1.0;
+    for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+        values[c] = fds[c] >= 0 ? (uint64_t)(data[3 + slots[c]] * scale) : 0;
+    }
+    return true;
+}
+#endif
+
+static bool open_counters(void) {
+    for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+        fds[c] = -1;
+    }
+
+#if defined(__linux__)
+    const uint32_t types[NUM_PERF_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+    };
+    const uint64_t configs[NUM_PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+            PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+        PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+            PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    group = open_counter(types[PERF_CYCLES], configs[PERF_CYCLES], -1);
+    if (group < 0) {
+        fprintf(stderr, "Error opening hardware counters (%s), running without them\n",
+                strerror(errno));
+        return false;
+    }
+    fds[PERF_CYCLES] = group;
+    slots[PERF_CYCLES] = num_open++;
+
+    for (int c = PERF_CYCLES + 1; c < NUM_PERF_COUNTERS; c++) {
+        fds[c] = open_counter(types[c], configs[c], group);
+        if (fds[c] < 0) {
+            fprintf(stderr, "Error opening %s counter (%s), left out\n", counter_names[c],
+                    strerror(errno));
+            continue;
+        }
+        slots[c] = num_open++;
+    }
+
+    ioctl(group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    fprintf(stderr, "Error opening hardware counters, only supported on Linux\n");
+    return false;
+#endif
+}
+
+static double per_item(uint64_t count, uint64_t items) {
+    return items > 0 ? (double)count / items : 0.0;
+}
+
+static void print_totals(const char *title, const perf_totals_t *totals) {
+    printf("%s, %llu triangles, %llu pixels\n", title, (unsigned long long)totals->triangles,
+           (unsigned long long)totals->pixels);
+    printf("  %-10s %14s %6s %12s %12s %12s %s\n", "stage", "cycles", "ipc", counter_names[2],
+           counter_names[3], counter_names[4], "(each per)");
+
+    for (int s = 0; s < NUM_PERF_STAGES; s++) {
+        const uint64_t *counts = totals->counts[s];
+        uint64_t items = stage_per_pixel[s] ? totals->pixels : totals->triangles;
+        printf("  %-10s %14llu %6.2f %12.4f %12.4f %12.4f %s\n", stage_names[s],
+               (unsigned long long)counts[PERF_CYCLES],
+               per_item(counts[PERF_INSTRUCTIONS], counts[PERF_CYCLES]),
+               per_item(counts[PERF_L1D_MISSES], items), per_item(counts[PERF_LLC_MISSES], items),
+               per_item(counts[PERF_BRANCH_MISSES], items),
+               stage_per_pixel[s] ? "pixel" : "triangle");
+    }
+
+    for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+        if (fds[c] < 0)
+            printf("  no %s counter on this machine, shown as 0\n", counter_names[c]);
+    }
+}
+
+// Everything since the last report, then starts over
+static void report(void) {
+    if (num_frames > 0) {
+        char title[64];
+        snprintf(title, sizeof(title), "all %d frames", num_frames);
+        print_totals(title, &total);
+    }
+    memset(&total, 0, sizeof(total));
+    num_frames = 0;
+}
+
+void perf_switch(void) {
+    if (!opened) {
+        opened = true;
+        available = open_counters();
+    }
+    if (!available)
+        return;
+
+    enabled = !enabled;
+    if (!enabled)
+        report();
+    memset(&frame, 0, sizeof(frame));
+}
+
+bool perf_enabled(void) { return enabled; }
+
+void perf_begin(perf_stage_e stage) {
+    (void)stage;
+#if defined(__linux__)
+    if (enabled && !read_counters(started))
+        memset(started, 0, sizeof(started));
+#endif
+}
+
+void perf_end(perf_stage_e stage) {
+#if defined(__linux__)
+    uint64_t values[NUM_PERF_COUNTERS];
+    if (!enabled || !read_counters(values))
+        return;
+
+    for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+        frame.counts[stage][c] += values[c] - started[c];
+    }
+#else
+    (void)stage;
+#endif
+}
+
+void perf_end_frame(int num_triangles, int num_pixels) {
+    if (!enabled)
+        return;
+
+    frame.triangles = num_triangles;
+    frame.pixels = num_pixels;
+    print_totals("frame", &frame);
+
+    for (int s = 0; s < NUM_PERF_STAGES; s++) {
+        for (int c = 0; c < NUM_PERF_COUNTERS; c++) {
+            total.counts[s][c] += frame.counts[s][c];
+        }
+    }
+    total.triangles += frame.triangles;
+    total.pixels += frame.pixels;
+    num_frames++;
+    memset(&frame, 0, sizeof(frame));
+}
+
+void perf_free(void) {
+    report();
+
+#if defined(__linux__)
+    // Never opened leaves the files zeroed, which would close stdin
+    for (int c = NUM_PERF_COUNTERS - 1; c >= 0 && opened; c--) {
+        if (fds[c] >= 0)
+            close(fds[c]);
+        fds[c] = -1;
+    }
+#endif
+
+    opened = false;
+    available = false;
+    enabled = false;
+    group = -1;
+    num_open = 0;
+    memset(&frame, 0, sizeof(frame));
+}
@@ -0,0 +1,45 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+
+// Parts of a frame the counters are split into, a stage can be entered many times a frame
+typedef enum {
+    PERF_STAGE_TRANSFORM, // backface tests and vertices to view space
+    PERF_STAGE_CLIP,      // clipping, projection and triangle setup
+    PERF_STAGE_SORT,      // painters sort
+    PERF_STAGE_RASTER,    // every triangle drawn, and the visibility resolve
+    PERF_STAGE_CLEAR,     // color, depth and visibility buffers
+    PERF_STAGE_PRESENT,   // upload and show
+    NUM_PERF_STAGES
+} perf_stage_e;
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    NUM_PERF_COUNTERS
+} perf_counter_e;
+
+// Off by default, sampling costs a system call at each stage boundary. The first switch opens the
+// hardware counters of the calling thread, Linux only. If there are none or the kernel won't give
+// them out it says so and sampling stays off, counters a machine lacks on their own are left out.
+// Switching off prints the totals so far and starts them again
+void perf_switch(void);
+
+bool perf_enabled(void);
+
+// Around a stage, nothing else may be sampled in between
+void perf_begin(perf_stage_e stage);
+void perf_end(perf_stage_e stage);
+
+// Prints the frame's counters per stage, as IPC and misses per triangle for the geometry and
+// raster stages and per pixel for clearing and presenting, then adds them to the totals
+void perf_end_frame(int num_triangles, int num_pixels);
+
+// Prints the totals of anything sampled since the last switch and closes the counters
+void perf_free(void);
+
+#endif
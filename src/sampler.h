@@ -0,0 +1,195 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "texture.h"
+
+// Texel coordinates are fixed point, with this many bits below a whole texel. Texel centers sit on
+// whole numbers, nearest rounds to them and bilinear blends between them
+#define SAMPLER_FRACTION_BITS 16
+#define SAMPLER_HALF (1 << (SAMPLER_FRACTION_BITS - 1))
+#define SAMPLER_MAX_FIXED (1 << 30) // keeps stepping along a row from overflowing
+
+// Picked once per draw, the rows have a loop for each so the pick isn't made per pixel
+typedef enum {
+    SAMPLER_NEAREST_POW2,       // wrapped power of two texture, a mask per axis and nothing else
+    SAMPLER_NEAREST_POW2_CLUT8, // the same through a 256 color palette
+    SAMPLER_NEAREST_POW2_CLUT4, // the same through a 16 color palette
+    SAMPLER_NEAREST,            // any size, address mode and format
+    SAMPLER_BILINEAR,           // the four nearest texels blended, any size, mode and format
+} sampler_kind_e;
+
+typedef struct {
+    const color_t *pixels;  // RGBA32 only
+    const uint8_t *indices; // indexed formats only, along with palette and stride
+    const color_t *palette;
+    int stride;
+    texture_format_e format;
+    int width, height;
+    int mask_x, mask_y;     // width and height - 1, only of use for powers of two
+    float scale_u, scale_v; // u and v to fixed point texels
+    texture_address_e address;
+    bool pow2;
+    sampler_kind_e kind;
+} sampler_t;
+
+static inline void sampler_init(sampler_t *sampler, const texture_t *texture, bool bilinear) {
+    *sampler = (sampler_t){
+        .pixels = texture->pixels,
+        .indices = texture->indices,
+        .palette = texture->palette,
+        .stride = texture->stride,
+        .format = texture->format,
+        .width = texture->width,
+        .height = texture->height,
+        .mask_x = texture->width - 1,
+        .mask_y = texture->height - 1,
+        .scale_u = (float)texture->width * (1 << SAMPLER_FRACTION_BITS),
+        .scale_v = (float)texture->height * (1 << SAMPLER_FRACTION_BITS),
+        .address = texture->address,
+        .pow2 = texture->pow2,
+    };
+
+    const sampler_kind_e pow2_kinds[NUM_TEXTURE_FORMATS] = {
+        [TEXTURE_RGBA32] = SAMPLER_NEAREST_POW2,
+        [TEXTURE_CLUT8] = SAMPLER_NEAREST_POW2_CLUT8,
+        [TEXTURE_CLUT4] = SAMPLER_NEAREST_POW2_CLUT4,
+    };
+    if (bilinear)
+        sampler->kind = SAMPLER_BILINEAR;
+    else if (texture->pow2 && texture->address == TEXTURE_WRAP)
+        sampler->kind = pow2_kinds[texture->format];
+    else
+        sampler->kind = SAMPLER_NEAREST;
+}
+
+// A u or v to fixed point texels, scale being the sampler's scale_u or scale_v. Wild coordinates
+// are held to a range that can't overflow, anything out there is many repeats away anyway
+static inline int32_t sampler_fixed(float coord, float scale) {
+    float fixed = coord * scale;
+    fixed = fixed > SAMPLER_MAX_FIXED ? SAMPLER_MAX_FIXED : fixed;
+    fixed = fixed < -SAMPLER_MAX_FIXED ? -SAMPLER_MAX_FIXED : fixed;
+    return (int32_t)fixed;
+}
+
+// A whole texel coordinate brought onto the texture, size - 1 is mask
+static inline int sampler_address(int texel, int size, int mask, texture_address_e address,
+                                  bool pow2) {
+    switch (address) {
+    case TEXTURE_CLAMP:
+        return texel < 0 ? 0 : texel > mask ? mask : texel;
+    case TEXTURE_MIRROR: {
+        int period = size * 2;
+        int t = pow2 ? texel & (period - 1) : texel % period;
+        t = t < 0 ? t + period : t;
+        return t < size ? t : period - 1 - t;
+    }
+    default: {
+        // Shifts and masks round towards negative infinity, so negatives wrap instead of mirroring
+        if (pow2)
+            return texel & mask;
+        int t = texel % size;
+        return t < 0 ? t + size : t;
+    }
+    }
+}
+
+static inline color_t sampler_clut8_texel(const sampler_t *sampler, int x, int y) {
+    return sampler->palette[sampler->indices[y * sampler->stride + x]];
+}
+
+static inline color_t sampler_clut4_texel(const sampler_t *sampler, int x, int y) {
+    uint8_t pair = sampler->indices[y * sampler->stride + (x >> 1)];
+    return sampler->palette[(pair >> ((x & 1) * 4)) & 0xF];
+}
+
+// Texel already on the texture, in whatever format it is stored
+static inline color_t sampler_texel(const sampler_t *sampler, int x, int y) {
+    switch (sampler->format) {
+    case TEXTURE_CLUT8:
+        return sampler_clut8_texel(sampler, x, y);
+    case TEXTURE_CLUT4:
+        return sampler_clut4_texel(sampler, x, y);
+    default:
+        return sampler->pixels[y * sampler->width + x];
+    }
+}
+
+static inline color_t sampler_nearest_pow2(const sampler_t *sampler, texture_format_e format,
+                                           int32_t x, int32_t y) {
+    int tex_x = ((x + SAMPLER_HALF) >> SAMPLER_FRACTION_BITS) & sampler->mask_x;
+    int tex_y = ((y + SAMPLER_HALF) >> SAMPLER_FRACTION_BITS) & sampler->mask_y;
+    switch (format) {
+    case TEXTURE_CLUT8:
+        return sampler_clut8_texel(sampler, tex_x, tex_y);
+    case TEXTURE_CLUT4:
+        return sampler_clut4_texel(sampler, tex_x, tex_y);
+    default:
+        return sampler->pixels[tex_y * sampler->width + tex_x];
+    }
+}
+
+static inline color_t sampler_nearest(const sampler_t *sampler, int32_t x, int32_t y) {
+    int tex_x = sampler_address((x + SAMPLER_HALF) >> SAMPLER_FRACTION_BITS, sampler->width,
+                                sampler->mask_x, sampler->address, sampler->pow2);
+    int tex_y = sampler_address((y + SAMPLER_HALF) >> SAMPLER_FRACTION_BITS, sampler->height,
+                                sampler->mask_y, sampler->address, sampler->pow2);
+    return sampler_texel(sampler, tex_x, tex_y);
+}
+
+// Blends two colors by weight out of 256, red with blue and green with alpha, two channels per
+// multiply as neither can carry into the other
+static inline uint32_t sampler_lerp(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t rb = ((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight) >> 8;
+    uint32_t ga = ((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight;
+    return (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+}
+
+static inline color_t sampler_bilinear(const sampler_t *sampler, int32_t x, int32_t y) {
+    // Top 8 bits of the fraction are the weights
+    int x0 = x >> SAMPLER_FRACTION_BITS, y0 = y >> SAMPLER_FRACTION_BITS;
+    uint32_t weight_x = (x >> (SAMPLER_FRACTION_BITS - 8)) & 0xFF;
+    uint32_t weight_y = (y >> (SAMPLER_FRACTION_BITS - 8)) & 0xFF;
+
+    int left = sampler_address(x0, sampler->width, sampler->mask_x, sampler->address,
+                               sampler->pow2);
+    int right = sampler_address(x0 + 1, sampler->width, sampler->mask_x, sampler->address,
+                                sampler->pow2);
+    int top = sampler_address(y0, sampler->height, sampler->mask_y, sampler->address,
+                              sampler->pow2);
+    int bottom = sampler_address(y0 + 1, sampler->height, sampler->mask_y, sampler->address,
+                                 sampler->pow2);
+
+    uint32_t upper = sampler_lerp(sampler_texel(sampler, left, top).abgr,
+                                  sampler_texel(sampler, right, top).abgr, weight_x);
+    uint32_t lower = sampler_lerp(sampler_texel(sampler, left, bottom).abgr,
+                                  sampler_texel(sampler, right, bottom).abgr, weight_x);
+    return (color_t)sampler_lerp(upper, lower, weight_y);
+}
+
+// Meant to be called with kind a constant, so each caller's loop is built for just that one
+static inline color_t sampler_fetch(const sampler_t *sampler, sampler_kind_e kind, int32_t x,
+                                    int32_t y) {
+    switch (kind) {
+    case SAMPLER_NEAREST_POW2:
+        return sampler_nearest_pow2(sampler, TEXTURE_RGBA32, x, y);
+    case SAMPLER_NEAREST_POW2_CLUT8:
+        return sampler_nearest_pow2(sampler, TEXTURE_CLUT8, x, y);
+    case SAMPLER_NEAREST_POW2_CLUT4:
+        return sampler_nearest_pow2(sampler, TEXTURE_CLUT4, x, y);
+    case SAMPLER_BILINEAR:
+        return sampler_bilinear(sampler, x, y);
+    default:
+        return sampler_nearest(sampler, x, y);
+    }
+}
+
+// For the odd lookup outside of a row loop
+static inline color_t sampler_sample(const sampler_t *sampler, float u, float v) {
+    return sampler_fetch(sampler, sampler->kind, sampler_fixed(u, sampler->scale_u),
+                         sampler_fixed(v, sampler->scale_v));
+}
+
+#endif
@@ -1,33 +1,76 @@
-#include <time.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 
 #include "array.h"
+#include "memory.h"
 #include "scene.h"
+#include "scene_file.h"
 
 #define M_PI 3.14159265358979323846
 
+// Meshes still waiting on their model get an empty box, which no query or frustum ever touches
+static void update_mesh_bounds(scene_t *scene) {
+    int num_meshes = array_size(scene->meshes);
+    for (int i = 0; i < num_meshes; i++) {
+        const mesh_t *mesh = &scene->meshes[i];
+        const model_t *model = &scene->models[mesh->model];
+        if (model->num_lods == 0) {
+            scene->mesh_bounds[i] = aabb_empty();
+            continue;
+        }
+
+        const mat4_t *world_matrix = &scene->nodes[mesh->node].world_matrix;
+        scene->mesh_bounds[i] = aabb_transform(model->bounds, world_matrix);
+    }
+}
+
 // Initialize all scene elements:
 // meshes, lights, the camera, projection matrix, frustum planes
-void scene_init(scene_t *scene) {
+void scene_init(scene_t *scene, const char *file_name) {
     scene->light = (light_t){
         .direction = {.x = 0.0f, .y = 0.0f, .z = 1.0f},
     };
 
-    srand(time(NULL));
+    // Only the description is read here, a missing file just leaves the scene empty
+    scene_file_t file = {0};
+    scene_file_load(&file, file_name);
+
+    // Fresh arrays come zeroed, so every model starts out not loaded
+    int num_models = array_size(file.models);
+    scene->models = array_hold(scene->models, num_models, sizeof(model_t));
+    for (int i = 0; i < num_models; i++) {
+        memory_name_asset(i, file.models[i].name);
+    }
+
+    // Every mesh and its node exists from the start, it just has nothing to draw yet. Bad mesh
+    // lines get a node but no mesh, so the meshes parented to lines after them stay attached
+    int num_meshes = array_size(file.meshes);
+    int *mesh_nodes = array_hold(NULL, num_meshes, sizeof(int));
+    for (int i = 0; i < num_meshes; i++) {
+        const scene_file_mesh_t *entry = &file.meshes[i];
+        int parent = entry->parent == -1 ? -1 : mesh_nodes[entry->parent];
+        mesh_nodes[i] =
+            node_add(&scene->nodes, parent, entry->rotation, entry->scale, entry->translation);
+        if (entry->model == -1)
+            continue;
 
-    // load all meshes, and allocate memory for screen meshes
-    for (int i = 0; i < 5; i++) {
-        float random = rand() / (float)RAND_MAX; // between 0.0 and 1.0
-        random -= 0.5f;                          // between -0.5 and 0.5
-        random *= 5.0f;                          // between -2.5 and 2.5
+        mesh_t mesh = {.model = entry->model, .occluder = entry->occluder, .node = mesh_nodes[i]};
+        array_push(scene->meshes, mesh);
+    }
+    array_free(mesh_nodes);
 
-        mesh_t temp_mesh = {0};
-        vec3_t rotation = {(i * random), (i * random), (i * random)};
-        vec3_t scale = {1.0f, 1.0f, 1.0f};
-        vec3_t position = {(i * random), (i * random), (i * random)};
-        mesh_init(&temp_mesh, "./assets/crab.obj", "./assets/crab.png", rotation, scale, position);
-        array_push(scene->meshes, temp_mesh);
+    int num_lights = array_size(file.lights);
+    for (int i = 0; i < num_lights; i++) {
+        const scene_file_light_t *entry = &file.lights[i];
+        local_light_t light = local_light_make(entry->position, entry->direction, entry->range,
+                                               entry->intensity, entry->cone_angle);
+        array_push(scene->lights, light);
     }
 
+    loader_start(&scene->loader, file.models);
+    scene_file_free(&file);
+
     camera_init(&scene->camera, (vec3_t){0, 0, 0}, (vec3_t){0, 1, 0}, (vec3_t){0, 0, 1});
 
     int window_width, window_height;
@@ -42,18 +85,280 @@ void scene_init(scene_t *scene) {
 
     scene->projection_matrix = mat4_make_perspective(fov_y, inv_aspect, z_near, z_far);
     frustum_planes_init(scene->frustum_planes, fov_x, fov_y, z_near, z_far);
+
+    // Nothing has loaded yet so every box is empty, each load that lands rebuilds the bvh
+    nodes_update(scene->nodes, &scene->view_matrix, scene->view_version);
+    scene->mesh_bounds = array_hold(scene->mesh_bounds, num_meshes, sizeof(aabb_t));
+    update_mesh_bounds(scene);
+    bvh_build(&scene->bvh, scene->mesh_bounds);
+    occlusion_init(&scene->occlusion);
 }
 
 void scene_free(scene_t *scene) {
+    // workers may still be writing models, they have to stop before anything is freed
+    loader_free(&scene->loader);
+
     // free all the meshes dynamic memory
     int num_meshes = array_size(scene->meshes);
     for (int i = 0; i < num_meshes; i++) {
         mesh_free(&scene->meshes[i]);
     }
 
+    int num_models = array_size(scene->models);
+    for (int i = 0; i < num_models; i++) {
+        model_free(&scene->models[i]);
+    }
+
     // free the dynamic list of meshes
     array_free(scene->meshes);
+    array_free(scene->models);
+    array_free(scene->nodes);
+    array_free(scene->mesh_bounds);
+    array_free(scene->visible_meshes);
+    array_free(scene->screen_sizes);
+    array_free(scene->lights);
+    light_grid_free(&scene->light_grid);
+    bvh_free(&scene->bvh);
+    occlusion_free(&scene->occlusion);
     *scene = (scene_t){0};
 
     memset(scene, 0, sizeof(scene_t));
 }
+
+bool scene_poll_loads(scene_t *scene) {
+    if (loader_done(&scene->loader))
+        return false;
+
+    int *finished = NULL; // dynamic array
+    loader_poll(&scene->loader, &finished);
+
+    int num_finished = array_size(finished);
+    int num_ready = 0;
+    for (int i = 0; i < num_finished; i++) {
+        // Failed ones are left for the loader to free
+        load_job_t *job = &scene->loader.jobs[finished[i]];
+        if (!job->loaded)
+            continue;
+
+        // The worker is done with it, the model moves into the scene as is
+        model_t *model = &scene->models[finished[i]];
+        *model = job->model;
+        job->model = (model_t){0};
+        model_report_locality(model, job->files.name);
+
+        int num_meshes = array_size(scene->meshes);
+        for (int m = 0; m < num_meshes; m++) {
+            if (scene->meshes[m].model == finished[i]) {
+                mesh_init(&scene->meshes[m], model);
+                num_ready++;
+            }
+        }
+    }
+    array_free(finished);
+
+    if (num_ready == 0)
+        return false;
+
+    // Boxes that were empty are somewhere else entirely now, refitting would leave a poor tree
+    update_mesh_bounds(scene);
+    bvh_build(&scene->bvh, scene->mesh_bounds);
+    return true;
+}
+
+// Rough diameter in pixels of the mesh's bounding sphere
+static float mesh_screen_size(const scene_t *scene, int mesh, int window_height) {
+    // Sphere around the world bounds
+    aabb_t bounds = scene->mesh_bounds[mesh];
+    vec3_t center = vec3_mul(vec3_add(bounds.min, bounds.max), 0.5f);
+    float radius = vec3_length(vec3_sub(bounds.max, center));
+
+    float distance = vec3_length(vec3_sub(center, scene->camera.position));
+    if (distance <= radius)
+        return INFINITY;
+
+    // m[1][1] is 1 / tan(fov_y / 2), so this is the diameter over the visible height at distance
+    return radius * scene->projection_matrix.m[1][1] * window_height / distance;
+}
+
+// Draws the biggest visible meshes into the occlusion buffer, then drops every visible mesh whose
+// bounds are completely behind them
+static void cull_occluded(scene_t *scene, const float *screen_sizes) {
+    float z_near = scene->frustum_planes[NEAR_FRUSTUM].point.z;
+    int num_visible = array_size(scene->visible_meshes);
+
+    // Designated occluders first, then the rest by size, biggest first
+    int occluders[OCCLUSION_MAX_OCCLUDERS];
+    float occluder_sizes[OCCLUSION_MAX_OCCLUDERS];
+    int num_occluders = 0;
+    for (int v = 0; v < num_visible; v++) {
+        int m = scene->visible_meshes[v];
+        float size = scene->meshes[m].occluder ? INFINITY : screen_sizes[v];
+        if (size < OCCLUSION_MIN_SIZE)
+            continue;
+
+        int slot = num_occluders < OCCLUSION_MAX_OCCLUDERS ? num_occluders++ : num_occluders;
+        while (slot > 0 && occluder_sizes[slot - 1] < size) {
+            if (slot < OCCLUSION_MAX_OCCLUDERS) {
+                occluders[slot] = occluders[slot - 1];
+                occluder_sizes[slot] = occluder_sizes[slot - 1];
+            }
+            slot--;
+        }
+        if (slot < OCCLUSION_MAX_OCCLUDERS) {
+            occluders[slot] = m;
+            occluder_sizes[slot] = size;
+        }
+    }
+
+    occlusion_clear(&scene->occlusion);
+    if (num_occluders == 0)
+        return;
+
+    // The level that is going to be drawn, so the buffer hides exactly what the screen will
+    for (int i = 0; i < num_occluders; i++) {
+        mesh_t *mesh = &scene->meshes[occluders[i]];
+        const mesh_lod_t *lod = &scene->models[mesh->model].lods[mesh->lod];
+        int num_vertices = array_size(lod->vertices);
+
+        mat4_mul_points_soa(&scene->nodes[mesh->node].model_view_matrix, lod->positions,
+                            mesh->view_positions, num_vertices);
+        occlusion_draw(&scene->occlusion, mesh->view_positions, num_vertices, lod->faces,
+                       &scene->projection_matrix, z_near);
+    }
+
+    // Occluders get tested too, one hidden behind another is dropped like anything else
+    int num_kept = 0;
+    for (int v = 0; v < num_visible; v++) {
+        int m = scene->visible_meshes[v];
+        if (occlusion_test(&scene->occlusion, scene->mesh_bounds[m], &scene->view_matrix,
+                           &scene->projection_matrix, z_near))
+            scene->visible_meshes[num_kept++] = m;
+    }
+    array_truncate(scene->visible_meshes, num_kept);
+}
+
+void scene_update_visibility(scene_t *scene, bool nodes_moved, bool view_changed,
+                             int window_height) {
+    if (nodes_moved) {
+        update_mesh_bounds(scene);
+        bvh_refit(&scene->bvh);
+    }
+
+    // The view matrix is rigid, so its inverse takes plane points and normals back to world
+    if (view_changed) {
+        mat4_t inverse_view = mat4_inverse(&scene->view_matrix);
+        for (int i = 0; i < NUM_PLANES; i++) {
+            plane_t plane = scene->frustum_planes[i];
+            vec4_t normal = {plane.normal.x, plane.normal.y, plane.normal.z, 0.0f};
+
+            scene->world_frustum_planes[i].point =
+                vec4_to_vec3(mat4_mul_vec4(&inverse_view, vec3_to_vec4(plane.point)));
+            scene->world_frustum_planes[i].normal =
+                vec4_to_vec3(mat4_mul_vec4(&inverse_view, normal));
+        }
+    }
+
+    array_reset(scene->visible_meshes);
+    bvh_cull_frustum(&scene->bvh, scene->world_frustum_planes, NUM_PLANES,
+                     &scene->visible_meshes);
+
+    // Far away meshes swap to a simpler level, everything after only sees that level. Subtrees
+    // completely inside the frustum come back whole, so meshes still loading get dropped here
+    int num_visible = array_size(scene->visible_meshes);
+    int num_loaded = 0;
+    array_reset(scene->screen_sizes);
+    scene->screen_sizes = array_hold(scene->screen_sizes, num_visible, sizeof(float));
+    for (int v = 0; v < num_visible; v++) {
+        int m = scene->visible_meshes[v];
+        mesh_t *mesh = &scene->meshes[m];
+        const model_t *model = &scene->models[mesh->model];
+        if (model->num_lods == 0)
+            continue;
+
+        scene->screen_sizes[num_loaded] = mesh_screen_size(scene, m, window_height);
+        mesh_select_lod(mesh, model, scene->screen_sizes[num_loaded]);
+        scene->visible_meshes[num_loaded++] = m;
+    }
+    array_truncate(scene->visible_meshes, num_loaded);
+    array_truncate(scene->screen_sizes, num_loaded);
+
+    cull_occluded(scene, scene->screen_sizes);
+}
+
+// Moller-Trumbore against every face of the full level, the ray goes to model space instead of
+// the faces to world
+static float ray_hit_mesh(void *data, int instance, vec3_t origin, vec3_t direction, float t_max) {
+    const scene_t *scene = data;
+    const mesh_t *mesh = &scene->meshes[instance];
+    const mesh_lod_t *full = &scene->models[mesh->model].lods[0];
+    const mat4_t *inverse_world = &scene->nodes[mesh->node].inverse_world_matrix;
+
+    // Not normalizing the direction keeps t the same as in world space
+    vec4_t model_direction = {direction.x, direction.y, direction.z, 0.0f};
+    vec3_t o = vec4_to_vec3(mat4_mul_vec4(inverse_world, vec3_to_vec4(origin)));
+    vec3_t d = vec4_to_vec3(mat4_mul_vec4(inverse_world, model_direction));
+
+    float closest = t_max;
+    int num_faces = array_size(full->faces);
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t a = full->vertices[full->faces[i].a];
+        vec3_t edge1 = vec3_sub(full->vertices[full->faces[i].b], a);
+        vec3_t edge2 = vec3_sub(full->vertices[full->faces[i].c], a);
+
+        vec3_t p = vec3_cross(d, edge2);
+        float determinant = vec3_dot(edge1, p);
+        if (fabsf(determinant) < FLT_EPSILON)
+            continue;
+        float inv_determinant = 1.0f / determinant;
+
+        vec3_t to_origin = vec3_sub(o, a);
+        float u = vec3_dot(to_origin, p) * inv_determinant;
+        if (u < 0.0f || u > 1.0f)
+            continue;
+
+        vec3_t q = vec3_cross(to_origin, edge1);
+        float v = vec3_dot(d, q) * inv_determinant;
+        if (v < 0.0f || u + v > 1.0f)
+            continue;
+
+        float t = vec3_dot(edge2, q) * inv_determinant;
+        if (t >= 0.0f && t < closest)
+            closest = t;
+    }
+
+    return closest < t_max ? closest : INFINITY;
+}
+
+int scene_pick_mesh(const scene_t *scene, vec3_t origin, vec3_t direction, float *t) {
+    return bvh_raycast(&scene->bvh, origin, direction, ray_hit_mesh, (void *)scene, t);
+}
+
+void scene_query_point(const scene_t *scene, vec3_t point, int **results) {
+    bvh_query_point(&scene->bvh, point, results);
+}
+
+void scene_pixel_ray(const scene_t *scene, int x, int y, int window_width, int window_height,
+                     vec3_t *origin, vec3_t *direction) {
+    // Undo the viewport, screen y grows down, then the projection's scale at a view depth of 1
+    float ndc_x = 2.0f * (x + 0.5f) / window_width - 1.0f;
+    float ndc_y = 1.0f - 2.0f * (y + 0.5f) / window_height;
+    vec3_t view_direction = {
+        ndc_x / scene->projection_matrix.m[0][0],
+        ndc_y / scene->projection_matrix.m[1][1],
+        1.0f,
+    };
+
+    // The rows of the view matrix are the camera's axes in world space, and its last column is
+    // the eye moved onto them
+    const mat4_t *view = &scene->view_matrix;
+    vec3_t axes[3], eye = {0};
+    for (int r = 0; r < 3; r++) {
+        axes[r] = (vec3_t){view->m[r][0], view->m[r][1], view->m[r][2]};
+        eye = vec3_sub(eye, vec3_mul(axes[r], view->m[r][3]));
+    }
+
+    *origin = eye;
+    *direction = vec3_add(vec3_add(vec3_mul(axes[0], view_direction.x),
+                                   vec3_mul(axes[1], view_direction.y)),
+                          vec3_mul(axes[2], view_direction.z));
+}
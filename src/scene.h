@@ -1,23 +1,65 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <stdbool.h>
+
+#include "bvh.h"
 #include "camera.h"
 #include "clip.h"
 #include "light.h"
+#include "loader.h"
 #include "matrix.h"
 #include "mesh.h"
+#include "node.h"
+#include "occlusion.h"
 
 #define MAX_TRIANGLES 16384
 
 typedef struct {
-    mesh_t *meshes; // dynamic array of meshes
+    model_t *models; // dynamic array, one per model in the scene file, empty until loaded
+    mesh_t *meshes;  // dynamic array of meshes, only drawn once their model has loaded
+    node_t *nodes;   // dynamic array of transform nodes, the scene graph
+    loader_t loader;
+    mat4_t view_matrix;
+    int view_version; // bumped every time the view matrix changes
     light_t light;
+    local_light_t *lights;   // dynamic array, world space, from the scene file
+    light_grid_t light_grid; // the lights reaching each screen tile, rebuilt every drawn frame
     camera_t camera;
     mat4_t projection_matrix;
-    plane_t frustum_planes[NUM_PLANES];
+    plane_t frustum_planes[NUM_PLANES];       // view space, for clipping
+    plane_t world_frustum_planes[NUM_PLANES]; // same planes in world space, for culling
+    aabb_t *mesh_bounds;                      // dynamic array, world bounds, empty until loaded
+    bvh_t bvh;                                // over mesh_bounds, instance ids are mesh indices
+    int *visible_meshes; // dynamic array, indices of meshes that might be seen this frame
+    float *screen_sizes; // dynamic array, size in pixels of every visible mesh, scratch
+    occlusion_t occlusion;
 } scene_t;
 
-// Assumes 0 initialization
-void scene_init(scene_t *scene);
+// Assumes 0 initialization. Reads the scene file and starts loading its models in the background,
+// returns before any of them has loaded
+void scene_init(scene_t *scene, const char *file_name);
 void scene_free(scene_t *scene);
+
+// Hands the models that finished loading since the last call over to their meshes, meant for the
+// start of a frame so nothing changes under one. Returns true if any mesh became drawable
+bool scene_poll_loads(scene_t *scene);
+
+// Refits the bvh if any node moved, moves the frustum to world space if the view changed, then
+// collects the meshes that are at least partially inside it into visible_meshes, picks their
+// level of detail and drops the ones hidden behind the biggest of them
+void scene_update_visibility(scene_t *scene, bool nodes_moved, bool view_changed,
+                             int window_height);
+
+// Closest mesh hit by the ray in world space, or -1, t is written on a hit and is in units of
+// direction
+int scene_pick_mesh(const scene_t *scene, vec3_t origin, vec3_t direction, float *t);
+
+// Appends every mesh whose world bounds contain point to results
+void scene_query_point(const scene_t *scene, vec3_t point, int **results);
+
+// World space ray from the eye through the middle of a pixel, as seen with the view the last
+// update built. direction reaches the far side of the pixel at a view depth of 1
+void scene_pixel_ray(const scene_t *scene, int x, int y, int window_width, int window_height,
+                     vec3_t *origin, vec3_t *direction);
 #endif
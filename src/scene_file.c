@@ -0,0 +1,160 @@
+#include "scene_file.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "array.h"
+
+#define SCENE_FILE_MAX_LINE 1024
+
+static int find_model(const scene_file_t *file, const char *name) {
+    int num_models = array_size(file->models);
+    for (int i = 0; i < num_models; i++) {
+        if (strcmp(file->models[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool parse_model(scene_file_t *file, const char *line) {
+    scene_file_model_t model = {0};
+    // Widths one less than the buffers, keep in sync with SCENE_FILE_MAX_NAME and _PATH
+    int read = 0;
+    if (sscanf(line, "model %63s %255s %255s%n", model.name, model.obj_file_name,
+               model.png_file_name, &read) != 3)
+        return false;
+
+    // Optional words after the files, how the texture is read and stored
+    const char *p = line + read;
+    char word[SCENE_FILE_MAX_NAME];
+    int word_length;
+    while (sscanf(p, "%63s%n", word, &word_length) == 1) {
+        p += word_length;
+
+        if (word[0] == '#')
+            break;
+        if (!texture_address_parse(word, &model.address) &&
+            !texture_format_parse(word, &model.format))
+            return false;
+    }
+
+    if (find_model(file, model.name) != -1) {
+        fprintf(stderr, "Error model %s is defined twice in scene file\n", model.name);
+        return false;
+    }
+
+    array_push(file->models, model);
+    return true;
+}
+
+static bool parse_mesh(scene_file_t *file, const char *line) {
+    char model_name[SCENE_FILE_MAX_NAME];
+    scene_file_mesh_t mesh = {.parent = -1};
+    int read = 0;
+    if (sscanf(line, "mesh %63s %f %f %f %f %f %f %f %f %f%n", model_name, &mesh.rotation.x,
+               &mesh.rotation.y, &mesh.rotation.z, &mesh.scale.x, &mesh.scale.y, &mesh.scale.z,
+               &mesh.translation.x, &mesh.translation.y, &mesh.translation.z, &read) != 10)
+        return false;
+
+    mesh.model = find_model(file, model_name);
+    if (mesh.model == -1) {
+        fprintf(stderr, "Error mesh uses model %s before it is defined in scene file\n",
+                model_name);
+        return false;
+    }
+
+    // Optional words after the transform
+    const char *p = line + read;
+    char word[SCENE_FILE_MAX_NAME];
+    int word_length;
+    while (sscanf(p, "%63s%n", word, &word_length) == 1) {
+        p += word_length;
+
+        if (word[0] == '#') {
+            break;
+        } else if (strcmp(word, "occluder") == 0) {
+            mesh.occluder = true;
+        } else if (strcmp(word, "parent") == 0) {
+            int parent;
+            if (sscanf(p, "%d%n", &parent, &word_length) != 1)
+                return false;
+            p += word_length;
+
+            // Parents have to come first, so nodes can be added in file order
+            if (parent < 0 || parent >= array_size(file->meshes))
+                return false;
+            mesh.parent = parent;
+        } else {
+            return false;
+        }
+    }
+
+    array_push(file->meshes, mesh);
+    return true;
+}
+
+static bool parse_light(scene_file_t *file, const char *line) {
+    scene_file_light_t light = {0};
+    vec3_t *p = &light.position;
+    vec3_t *d = &light.direction;
+    bool spot = sscanf(line, "light point %f %f %f %f %f", &p->x, &p->y, &p->z, &light.range,
+                       &light.intensity) != 5;
+    if (spot && sscanf(line, "light spot %f %f %f %f %f %f %f %f %f", &p->x, &p->y, &p->z, &d->x,
+                       &d->y, &d->z, &light.cone_angle, &light.range, &light.intensity) != 9)
+        return false;
+
+    // A spot needs somewhere to point and a cone to light
+    if (light.range <= 0.0f || (spot && (vec3_length(*d) == 0.0f || light.cone_angle <= 0.0f)))
+        return false;
+
+    array_push(file->lights, light);
+    return true;
+}
+
+bool scene_file_load(scene_file_t *file, const char *file_name) {
+    FILE *stream = fopen(file_name, "r");
+    if (stream == NULL) {
+        fprintf(stderr, "Error opening scene file %s\n", file_name);
+        return false;
+    }
+
+    char buffer[SCENE_FILE_MAX_LINE];
+    int line_number = 0;
+    while (fgets(buffer, SCENE_FILE_MAX_LINE, stream)) {
+        line_number++;
+
+        // The parsers match the keyword literally, indented lines start at it too
+        const char *line = buffer + strspn(buffer, " \t");
+        char keyword[16];
+        if (sscanf(line, "%15s", keyword) != 1 || keyword[0] == '#')
+            continue;
+
+        bool parsed = false;
+        if (strcmp(keyword, "model") == 0)
+            parsed = parse_model(file, line);
+        else if (strcmp(keyword, "mesh") == 0)
+            parsed = parse_mesh(file, line);
+        else if (strcmp(keyword, "light") == 0)
+            parsed = parse_light(file, line);
+        if (parsed)
+            continue;
+
+        fprintf(stderr, "Skipped bad line %d in scene file %s\n", line_number, file_name);
+        // Parents are indices of mesh lines, a bad one still takes its place so they stay right
+        if (strcmp(keyword, "mesh") == 0) {
+            scene_file_mesh_t placeholder = {.model = -1, .parent = -1, .scale = {1, 1, 1}};
+            array_push(file->meshes, placeholder);
+        }
+    }
+
+    fclose(stream);
+    return true;
+}
+
+void scene_file_free(scene_file_t *file) {
+    array_free(file->models);
+    array_free(file->meshes);
+    array_free(file->lights);
+
+    memset(file, 0, sizeof(scene_file_t));
+}
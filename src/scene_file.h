@@ -0,0 +1,56 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <stdbool.h>
+
+#include "texture.h"
+#include "vector.h"
+
+#define SCENE_FILE_MAX_NAME 64
+#define SCENE_FILE_MAX_PATH 256
+
+typedef struct {
+    char name[SCENE_FILE_MAX_NAME];
+    char obj_file_name[SCENE_FILE_MAX_PATH];
+    char png_file_name[SCENE_FILE_MAX_PATH];
+    texture_address_e address;
+    texture_format_e format;
+} scene_file_model_t;
+
+typedef struct {
+    int model;  // index into models, -1 for a bad line that only keeps later parents in place
+    int parent; // index of an earlier mesh this one is attached to, or -1
+    vec3_t rotation;
+    vec3_t scale;
+    vec3_t translation;
+    bool occluder;
+} scene_file_mesh_t;
+
+typedef struct {
+    vec3_t position;
+    vec3_t direction; // spots only
+    float range;
+    float intensity;
+    float cone_angle; // half angle in radians for spots, 0 for points
+} scene_file_light_t;
+
+// What a scene is made of, with no data loaded yet
+typedef struct {
+    scene_file_model_t *models; // dynamic array
+    scene_file_mesh_t *meshes;  // dynamic array, in file order
+    scene_file_light_t *lights; // dynamic array
+} scene_file_t;
+
+// Line based text file, # starts a comment:
+//   model <name> <obj file> <png file> [wrap|clamp|mirror] [rgba32|clut8|clut4]
+//   mesh <model name> <rotation xyz> <scale xyz> <translation xyz> [parent <mesh>] [occluder]
+//   light point <position xyz> <range> <intensity>
+//   light spot <position xyz> <direction xyz> <cone half angle> <range> <intensity>
+// Lines may be indented. Textures wrap and are stored as rgba32 unless the model says otherwise. A
+// parent is the 0 based index of an earlier mesh line, its transform is then relative to that
+// mesh. Returns false if the file could not be read, bad lines are skipped and reported
+bool scene_file_load(scene_file_t *file, const char *file_name);
+
+void scene_file_free(scene_file_t *file);
+
+#endif
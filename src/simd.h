@@ -0,0 +1,16 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Picks the widest instruction set the compiler was told it may use, SSE is always there on
+// x86-64, AVX needs -mavx or -march=native. Build with -DNO_SIMD to force the scalar paths
+#if !defined(NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#define SIMD_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#if !defined(NO_SIMD) && defined(__AVX__)
+#define SIMD_AVX 1
+#include <immintrin.h>
+#endif
+
+#endif
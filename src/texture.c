@@ -1,44 +1,216 @@
 #include "texture.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <stb/stb_image.h>
 
 #include "display.h"
+#include "trace.h"
 #include "vector.h"
 
+#define QUANTIZE_CHANNELS 4 // alpha gets its own say, cut outs keep their edges
+
 void texture_free(texture_t *texture) {
-    free(texture->pixels);
+    stbi_image_free(texture->pixels);
+    free(texture->indices);
+    free(texture->palette);
 
     memset(texture, 0, sizeof(texture_t));
 }
 
 void load_png_texture_data(texture_t *texture, const char *filename) {
+    // Asking for 4 channels gives r, g, b, a bytes per pixel, exactly how color_t sits in memory,
+    // so stb's buffer becomes the texture as is, without a second copy of the image
     int channels;
+    TRACE_BEGIN("stbi_load");
     stbi_uc *bytes = stbi_load(filename, &texture->width, &texture->height, &channels, 4);
+    TRACE_END();
 
     if (bytes == NULL) {
         fprintf(stderr, "Error in STB loading texture data");
         return;
     }
 
-    int texture_size = texture->width * texture->height;
-    texture->pixels = (color_t *)malloc(texture_size * sizeof(color_t));
+    // Palettized as asked for once there are pixels to do it with
+    texture_format_e format = texture->format;
+    texture->format = TEXTURE_RGBA32;
+    texture->pixels = (color_t *)bytes;
+    texture->pow2 = (texture->width & (texture->width - 1)) == 0 &&
+                    (texture->height & (texture->height - 1)) == 0;
 
-    if (texture == NULL) {
-        fprintf(stderr, "Error allocating memory for mesh texture");
-        return;
+    if (format != TEXTURE_RGBA32 && !texture_palettize(texture, format))
+        fprintf(stderr, "Error palettizing texture %s, kept as it is\n", filename);
+}
+
+// A run of pixels in the order all the boxes share, cut in two until there are enough of them
+typedef struct {
+    int start, count;
+    int channel; // widest one
+    int range;   // of that channel, 0 once every pixel in the box has the same color
+} quantize_box_t;
+
+static int channel_value(color_t color, int channel) {
+    return (color.abgr >> (channel * 8)) & 0xFF;
+}
+
+static void box_measure(quantize_box_t *box, const color_t *pixels, const int *order) {
+    int min[QUANTIZE_CHANNELS] = {255, 255, 255, 255};
+    int max[QUANTIZE_CHANNELS] = {0};
+    for (int i = box->start; i < box->start + box->count; i++) {
+        for (int c = 0; c < QUANTIZE_CHANNELS; c++) {
+            int value = channel_value(pixels[order[i]], c);
+            min[c] = value < min[c] ? value : min[c];
+            max[c] = value > max[c] ? value : max[c];
+        }
     }
 
-    for (int i = 0, j = 0; i < texture_size; i++, j += 4) {
-        texture->pixels[i].r = bytes[j];
-        texture->pixels[i].g = bytes[j + 1];
-        texture->pixels[i].b = bytes[j + 2];
-        texture->pixels[i].a = bytes[j + 3];
+    box->range = -1;
+    for (int c = 0; c < QUANTIZE_CHANNELS; c++) {
+        if (max[c] - min[c] > box->range) {
+            box->range = max[c] - min[c];
+            box->channel = c;
+        }
     }
+}
 
-    stbi_image_free(bytes);
+// Cuts the box at the median of its widest channel, keeping the pixels at or below it and handing
+// the rest to other. Neither side is ever empty as the box has at least two values in that channel
+static void box_split(quantize_box_t *box, quantize_box_t *other, const color_t *pixels,
+                      int *order, int *scratch) {
+    int histogram[256] = {0};
+    for (int i = box->start; i < box->start + box->count; i++) {
+        histogram[channel_value(pixels[order[i]], box->channel)]++;
+    }
+
+    int below = 0, split = 0;
+    for (; split < 256; split++) {
+        below += histogram[split];
+        if (below * 2 >= box->count)
+            break;
+    }
+    // The median is the biggest value, so cut just under it instead
+    if (below == box->count) {
+        below -= histogram[split--];
+        while (histogram[split] == 0)
+            split--;
+    }
+
+    // Stable, left then right, a counting sort with two buckets
+    int left = 0, right = below;
+    for (int i = box->start; i < box->start + box->count; i++) {
+        if (channel_value(pixels[order[i]], box->channel) <= split)
+            scratch[left++] = order[i];
+        else
+            scratch[right++] = order[i];
+    }
+    memcpy(&order[box->start], scratch, box->count * sizeof(int));
+
+    *other = (quantize_box_t){.start = box->start + below, .count = box->count - below};
+    box->count = below;
+    box_measure(box, pixels, order);
+    box_measure(other, pixels, order);
+}
+
+bool texture_palettize(texture_t *texture, texture_format_e format) {
+    int palette_size = texture_palette_size(format);
+    if (texture->format != TEXTURE_RGBA32 || texture->pixels == NULL || palette_size == 0)
+        return false;
+
+    int num_pixels = texture->width * texture->height;
+    if (num_pixels <= 0)
+        return false;
+    int stride = format == TEXTURE_CLUT4 ? (texture->width + 1) / 2 : texture->width;
+    int *order = malloc(num_pixels * sizeof(int));
+    int *scratch = malloc(num_pixels * sizeof(int));
+    uint8_t *indices = calloc((size_t)stride * texture->height, 1);
+    color_t *palette = calloc(palette_size, sizeof(color_t));
+    if (order == NULL || scratch == NULL || indices == NULL || palette == NULL) {
+        free(order);
+        free(scratch);
+        free(indices);
+        free(palette);
+        return false;
+    }
+
+    for (int i = 0; i < num_pixels; i++) {
+        order[i] = i;
+    }
+
+    // Always the box spanning the most of any channel next, until every box is a single color
+    quantize_box_t boxes[256];
+    boxes[0] = (quantize_box_t){.start = 0, .count = num_pixels};
+    box_measure(&boxes[0], texture->pixels, order);
+    int num_boxes = 1;
+    while (num_boxes < palette_size) {
+        int widest = 0;
+        for (int b = 1; b < num_boxes; b++) {
+            if (boxes[b].range > boxes[widest].range)
+                widest = b;
+        }
+        if (boxes[widest].range <= 0)
+            break;
+        box_split(&boxes[widest], &boxes[num_boxes++], texture->pixels, order, scratch);
+    }
+
+    // Every box becomes the average of its pixels, and they all point at it
+    for (int b = 0; b < num_boxes; b++) {
+        const quantize_box_t *box = &boxes[b];
+        uint64_t sums[QUANTIZE_CHANNELS] = {0};
+        for (int i = box->start; i < box->start + box->count; i++) {
+            int pixel = order[i];
+            for (int c = 0; c < QUANTIZE_CHANNELS; c++) {
+                sums[c] += channel_value(texture->pixels[pixel], c);
+            }
+
+            int x = pixel % texture->width, y = pixel / texture->width;
+            if (format == TEXTURE_CLUT4)
+                indices[y * stride + x / 2] |= b << ((x & 1) * 4);
+            else
+                indices[y * stride + x] = b;
+        }
+
+        uint32_t abgr = 0;
+        for (int c = 0; c < QUANTIZE_CHANNELS; c++) {
+            abgr |= (uint32_t)((sums[c] + box->count / 2) / box->count) << (c * 8);
+        }
+        palette[b].abgr = abgr;
+    }
+    free(order);
+    free(scratch);
+
+    stbi_image_free(texture->pixels);
+    texture->pixels = NULL;
+    texture->indices = indices;
+    texture->palette = palette;
+    texture->stride = stride;
+    texture->format = format;
+    return true;
+}
+
+static const char *const address_names[NUM_TEXTURE_ADDRESS_MODES] = {"wrap", "clamp", "mirror"};
+
+bool texture_address_parse(const char *word, texture_address_e *address) {
+    for (int a = 0; a < NUM_TEXTURE_ADDRESS_MODES; a++) {
+        if (strcmp(word, address_names[a]) == 0) {
+            *address = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *const format_names[NUM_TEXTURE_FORMATS] = {"rgba32", "clut8", "clut4"};
+
+bool texture_format_parse(const char *word, texture_format_e *format) {
+    for (int f = 0; f < NUM_TEXTURE_FORMATS; f++) {
+        if (strcmp(word, format_names[f]) == 0) {
+            *format = f;
+            return true;
+        }
+    }
+    return false;
 }
 
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
@@ -67,67 +239,3 @@ vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
     vec3_t weights = {alpha, beta, gamma};
     return weights;
 }
-
-void draw_affine_texel(int x, int y, vec2_t a, vec2_t b, vec2_t c, tex2_t a_uv, tex2_t b_uv,
-                       tex2_t c_uv, const texture_t *texture) {
-    vec2_t p = {x, y};
-    vec3_t weights = barycentric_weights(a, b, c, p);
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    tex2_t interp = {
-        .u = a_uv.u * alpha + b_uv.u * beta + c_uv.u * gamma,
-        .v = a_uv.v * alpha + b_uv.v * beta + c_uv.v * gamma,
-    };
-
-    int tex_x = (int)fabsf(roundf(interp.u * texture->width)) % texture->width;
-    int tex_y = (int)fabsf(roundf(interp.v * texture->height)) % texture->height;
-
-    int index = tex_y * texture->width + tex_x;
-
-    draw_pixel(x, y, texture->pixels[index]);
-}
-
-void draw_texel(int x, int y, vec4_t a, vec4_t b, vec4_t c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv,
-                const texture_t *texture) {
-    vec2_t p = {x, y};
-    vec2_t a_2 = vec4_to_vec2(a);
-    vec2_t b_2 = vec4_to_vec2(b);
-    vec2_t c_2 = vec4_to_vec2(c);
-
-    vec3_t weights = barycentric_weights(a_2, b_2, c_2, p);
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // 1/z is related linearly to the point p, original z is saved in w so 1/w
-
-    // interpolated U/w and V/w, perspective divide over the interpolated point
-    tex2_t interp_uv = {
-        .u = (a_uv.u / a.w) * alpha + (b_uv.u / b.w) * beta + (c_uv.u / c.w) * gamma,
-        .v = (a_uv.v / a.w) * alpha + (b_uv.v / b.w) * beta + (c_uv.v / c.w) * gamma,
-    };
-
-    // we also need to interpolate 1/w for our current pixel
-    float interp_inv_w = (1 / a.w) * alpha + (1 / b.w) * beta + (1 / c.w) * gamma;
-
-    // now "undo"
-    interp_uv.u /= interp_inv_w;
-    interp_uv.v /= interp_inv_w;
-
-    // Modulo is hacky clamp
-    int tex_x = (int)fabsf(roundf(interp_uv.u * texture->width));
-    tex_x = tex_x % texture->width;
-    int tex_y = (int)fabsf(roundf(interp_uv.v * texture->height));
-    tex_y = tex_y % texture->height;
-
-    int index = tex_y * texture->width + tex_x;
-
-    // Only draw the pixel if depth value is greater (closer) than already there
-    // Remember 1/w will grow bigger when z is lower (closer)
-    if (interp_inv_w > w_buffer_at(x, y)) {
-        draw_pixel(x, y, texture->pixels[index]);
-        update_w_buffer(x, y, interp_inv_w);
-    }
-}
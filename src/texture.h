@@ -1,6 +1,8 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "display.h"
@@ -11,31 +13,72 @@ typedef struct {
     float v;
 } tex2_t;
 
+// What happens to coordinates outside of 0 to 1
+typedef enum {
+    TEXTURE_WRAP,   // repeats
+    TEXTURE_CLAMP,  // the edge texels carry on
+    TEXTURE_MIRROR, // repeats, every other copy flipped
+    NUM_TEXTURE_ADDRESS_MODES
+} texture_address_e;
+
+// How texels are stored, indexed ones are looked up in a color lookup table (CLUT) of their own,
+// like the PS1 did, for a quarter or an eighth of the memory
+typedef enum {
+    TEXTURE_RGBA32, // a color_t per texel
+    TEXTURE_CLUT8,  // a byte per texel, into 256 colors
+    TEXTURE_CLUT4,  // half a byte per texel, into 16 colors, low half first
+    NUM_TEXTURE_FORMATS
+} texture_format_e;
+
 typedef struct {
     int width, height;
-    color_t *pixels;
+    color_t *pixels;  // RGBA32 only, owned by stb_image, see texture_free
+    uint8_t *indices; // indexed only, rows of stride bytes
+    color_t *palette; // indexed only, 256 or 16 colors
+    int stride;       // bytes per row of indices
+    texture_address_e address;
+    texture_format_e format;
+    bool pow2; // both sides are powers of two, so wrapping is a mask instead of a divide
 } texture_t;
 
 void texture_free(texture_t *texture);
 
+static inline bool texture_loaded(const texture_t *texture) {
+    return texture->pixels != NULL || texture->indices != NULL;
+}
+
+// Colors in the palette of an indexed format
+static inline int texture_palette_size(texture_format_e format) {
+    return format == TEXTURE_CLUT8 ? 256 : format == TEXTURE_CLUT4 ? 16 : 0;
+}
+
+// What the texels and the palette take up
+static inline long long texture_bytes(const texture_t *texture) {
+    if (texture->format == TEXTURE_RGBA32)
+        return (long long)texture->width * texture->height * sizeof(color_t);
+    return (long long)texture->stride * texture->height +
+           texture_palette_size(texture->format) * sizeof(color_t);
+}
+
 void load_redbrick_mesh_texture(texture_t *texture);
 
+// Decodes straight into the texture's pixels, safe to call from several threads at once. The
+// address mode and format are left as they were, indexed formats are palettized straight away
 void load_png_texture_data(texture_t *texture, const char *filename);
 
+// Replaces the pixels of an RGBA32 texture with indices into a palette of the format's size, made
+// by median cut. Exact when there are no more colors than that, so images that were palettized
+// to begin with come out as they went in. False, with the texture left as it was, if out of memory
+bool texture_palettize(texture_t *texture, texture_format_e format);
+
+// Mode named by word (wrap, clamp or mirror), false if there is no such mode
+bool texture_address_parse(const char *word, texture_address_e *address);
+
+// Format named by word (rgba32, clut8 or clut4), false if there is no such format
+bool texture_format_parse(const char *word, texture_format_e *format);
+
 // Return barycentric weights of vertices alpha, beta, gamma with respect to
 // point p
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p);
 
-// Draw texel based not only on xy coords of point, but also it's interpolated
-// uv coords from triangle vertice info We pass in x and y as int so that we
-// draw at the right discrete pixel, everything else is calculated using
-// floating point
-void draw_affine_texel(int x, int y, vec2_t a, vec2_t b, vec2_t c, tex2_t a_uv, tex2_t b_uv,
-                       tex2_t c_uv, const texture_t *texture);
-
-// Draw texel same as above but passing in extra information for perspective
-// correct interpolation
-void draw_texel(int x, int y, vec4_t a, vec4_t b, vec4_t c, tex2_t a_uv, tex2_t b_uv, tex2_t c_uv,
-                const texture_t *texture);
-
 #endif
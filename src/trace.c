@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#if defined(TRACE)
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+typedef struct {
+    const char *name; // NULL for an end
+    uint64_t time;    // performance counter ticks
+    int id;
+} trace_event_t;
+
+typedef struct {
+    trace_event_t events[TRACE_BUFFER_EVENTS];
+    uint64_t count; // every event ever written, published after the event itself
+} trace_buffer_t;
+
+static trace_buffer_t *buffers[TRACE_MAX_THREADS];
+static int num_buffers = 0;
+static __thread trace_buffer_t *thread_buffer = NULL;
+static __thread bool thread_full = false; // no buffer left for this thread, it goes untraced
+
+// A thread's first event claims it a buffer of its own
+static trace_buffer_t *get_thread_buffer(void) {
+    if (thread_buffer != NULL || thread_full)
+        return thread_buffer;
+
+    int slot = __atomic_fetch_add(&num_buffers, 1, __ATOMIC_RELAXED);
+    if (slot >= TRACE_MAX_THREADS) {
+        thread_full = true;
+        return NULL;
+    }
+
+    thread_buffer = calloc(1, sizeof(trace_buffer_t));
+    __atomic_store_n(&buffers[slot], thread_buffer, __ATOMIC_RELEASE);
+    return thread_buffer;
+}
+
+static void trace_write(const char *name, int id) {
+    trace_buffer_t *buffer = get_thread_buffer();
+    if (buffer == NULL)
+        return;
+
+    uint64_t count = buffer->count;
+    buffer->events[count % TRACE_BUFFER_EVENTS] =
+        (trace_event_t){.name = name, .time = SDL_GetPerformanceCounter(), .id = id};
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name, int id) { trace_write(name, id); }
+
+void trace_end(void) { trace_write(NULL, -1); }
+
+void trace_dump(const char *file_name) {
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening trace file %s\n", file_name);
+        return;
+    }
+
+    double ticks_per_us = SDL_GetPerformanceFrequency() / 1e6;
+    uint64_t start = UINT64_MAX; // earliest event kept, the timeline starts at 0 there
+    int num_threads = __atomic_load_n(&num_buffers, __ATOMIC_RELAXED);
+    num_threads = num_threads < TRACE_MAX_THREADS ? num_threads : TRACE_MAX_THREADS;
+
+    for (int t = 0; t < num_threads; t++) {
+        trace_buffer_t *buffer = __atomic_load_n(&buffers[t], __ATOMIC_ACQUIRE);
+        uint64_t count = buffer ? __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE) : 0;
+        uint64_t first = count > TRACE_BUFFER_EVENTS ? count - TRACE_BUFFER_EVENTS : 0;
+        if (count > first && buffer->events[first % TRACE_BUFFER_EVENTS].time < start)
+            start = buffer->events[first % TRACE_BUFFER_EVENTS].time;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first_event = true;
+    for (int t = 0; t < num_threads; t++) {
+        trace_buffer_t *buffer = __atomic_load_n(&buffers[t], __ATOMIC_ACQUIRE);
+        if (buffer == NULL)
+            continue;
+
+        uint64_t count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        uint64_t first = count > TRACE_BUFFER_EVENTS ? count - TRACE_BUFFER_EVENTS : 0;
+
+        // Ends whose begin was overwritten would close somebody else's event
+        int depth = 0;
+        for (uint64_t e = first; e < count; e++) {
+            const trace_event_t *event = &buffer->events[e % TRACE_BUFFER_EVENTS];
+            if (event->name == NULL && depth == 0)
+                continue;
+            depth += event->name != NULL ? 1 : -1;
+
+            double ts = (event->time - start) / ticks_per_us;
+            fprintf(file, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+                    first_event ? "" : ",\n", event->name != NULL ? 'B' : 'E', t, ts);
+            if (event->name != NULL)
+                fprintf(file, ",\"name\":\"%s\"", event->name);
+            if (event->id >= 0)
+                fprintf(file, ",\"args\":{\"id\":%d}", event->id);
+            fprintf(file, "}");
+            first_event = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+        fprintf(stderr, "Error writing trace file %s\n", file_name);
+}
+
+void trace_free(void) {
+    int num_threads = __atomic_load_n(&num_buffers, __ATOMIC_RELAXED);
+    num_threads = num_threads < TRACE_MAX_THREADS ? num_threads : TRACE_MAX_THREADS;
+    for (int t = 0; t < num_threads; t++) {
+        free(buffers[t]);
+        buffers[t] = NULL;
+    }
+    num_buffers = 0;
+    thread_buffer = NULL;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline of what every thread was doing, written out as Chrome trace event json for Perfetto or
+// chrome://tracing, where single slow frames and stalls show up that averages hide. Only built in
+// with -DTRACE (make trace), otherwise every macro is nothing at all
+
+#define TRACE_FILE_NAME "./trace.json"
+#define TRACE_MAX_THREADS 32
+#define TRACE_BUFFER_EVENTS (1 << 16) // per thread, the oldest are overwritten once it is full
+
+#if defined(TRACE)
+
+// Names are kept as pointers, so they have to be string literals. Every begin needs an end on the
+// same thread, id is shown with the event when it isn't -1
+#define TRACE_BEGIN(name) trace_begin((name), -1)
+#define TRACE_BEGIN_ID(name, id) trace_begin((name), (id))
+#define TRACE_END() trace_end()
+#define TRACE_DUMP(file_name) trace_dump(file_name)
+#define TRACE_FREE() trace_free()
+
+// Every thread writes only its own buffer, so nothing is ever locked or waited on
+void trace_begin(const char *name, int id);
+void trace_end(void);
+
+// Writes every buffer as it is, events still being written by other threads may be left out
+void trace_dump(const char *file_name);
+
+// Only once no other thread is tracing any more
+void trace_free(void);
+
+#else
+
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_BEGIN_ID(name, id) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_DUMP(file_name) ((void)0)
+#define TRACE_FREE() ((void)0)
+
+#endif
+
+#endif
@@ -1,6 +1,7 @@
 #include "triangle.h"
 
 #include "display.h"
+#include "sampler.h"
 #include "texture.h"
 
 // utility for sorting
@@ -23,8 +24,8 @@ static void tex2_swap(tex2_t *a, tex2_t *b) {
 }
 
 int triangle_painter_compare(const void *t1, const void *t2) {
-    float avg1 = ((triangle_t *)t1)->avg_depth;
-    float avg2 = ((triangle_t *)t2)->avg_depth;
+    float avg1 = ((const triangle_setup_t *)t1)->depth;
+    float avg2 = ((const triangle_setup_t *)t2)->depth;
     return (avg1 > avg2) ? -1 : (avg2 > avg1);
 }
 
@@ -58,319 +59,528 @@ void sort_triangle_by_y(triangle_t *triangle) {
     }
 }
 
-static void draw_w_pixel(int x, int y, vec4_t a, vec4_t b, vec4_t c, color_t color) {
-    vec2_t p = {x, y};
-    vec2_t a_2 = vec4_to_vec2(a);
-    vec2_t b_2 = vec4_to_vec2(b);
-    vec2_t c_2 = vec4_to_vec2(c);
-
-    vec3_t weights = barycentric_weights(a_2, b_2, c_2, p);
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    float interp_inv_w = (1 / a.w) * alpha + (1 / b.w) * beta + (1 / c.w) * gamma;
-
-    if (interp_inv_w > w_buffer_at(x, y)) {
-        draw_pixel(x, y, color);
-        update_w_buffer(x, y, interp_inv_w);
-    }
+// Slopes of the plane through the three vertex values f, from its deltas along ab and ac
+static void plane_slopes(const float f[3], vec2_t ab, vec2_t ac, float inv_det, float *dx,
+                         float *dy) {
+    float along_ab = f[1] - f[0], along_ac = f[2] - f[0];
+    *dx = (along_ab * ac.y - along_ac * ab.y) * inv_det;
+    *dy = (along_ac * ab.x - along_ab * ac.x) * inv_det;
 }
 
-static void fill_flat_bottom_triangle(const triangle_t *triangle) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
+bool triangle_setup_init(triangle_setup_t *setup, const triangle_t *triangle) {
+    // Rasterization walks vertices from top to bottom
+    triangle_t sorted = *triangle;
+    sort_triangle_by_y(&sorted);
 
-    float dx_1 = roundf(b.x) - roundf(a.x);
-    float dy_1 = roundf(b.y) - roundf(a.y);
-    // inverse slope, for every 1 increment in y, how much to step in x?
-    float xstep_1 = dx_1 / dy_1;
+    for (int i = 0; i < 3; i++) {
+        setup->x[i] = sorted.points[i].x;
+        setup->y[i] = sorted.points[i].y;
+        setup->inv_w[i] = 1.0f / sorted.points[i].w;
+        setup->uv[i] = sorted.tex_coords[i];
+    }
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
-    // inverse slope, for every 1 increment in y, how much to step in x?
-    float xstep_2 = dx_2 / dy_2;
+    // Pixel centers sit on whole coordinates, a box without a whole x or y in it has none inside.
+    // Distant dense meshes are mostly made of these
+    float x_min = fminf(setup->x[0], fminf(setup->x[1], setup->x[2]));
+    float x_max = fmaxf(setup->x[0], fmaxf(setup->x[1], setup->x[2]));
+    if (ceilf(x_min) > floorf(x_max) || ceilf(setup->y[0]) > floorf(setup->y[2]))
+        return false;
+
+    // Lines and points, also catches the NaNs of vertices at infinity
+    vec2_t ab = {setup->x[1] - setup->x[0], setup->y[1] - setup->y[0]};
+    vec2_t ac = {setup->x[2] - setup->x[0], setup->y[2] - setup->y[0]};
+    float det = ab.x * ac.y - ac.x * ab.y;
+    if (!(fabsf(det) >= TRIANGLE_MIN_AREA))
+        return false;
+    setup->inv_area = 1.0f / det;
+
+    // Flipped for counter clockwise ones, so inside is always positive
+    float side = det > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < 3; i++) {
+        int next = i == 2 ? 0 : i + 1;
+        setup->edge_a[i] = side * (setup->y[i] - setup->y[next]);
+        setup->edge_b[i] = side * (setup->x[next] - setup->x[i]);
+    }
 
-    int y_start = roundf(a.y);
-    int y_end = roundf(b.y);
+    float u_w[3], v_w[3];
+    for (int i = 0; i < 3; i++) {
+        u_w[i] = setup->uv[i].u * setup->inv_w[i];
+        v_w[i] = setup->uv[i].v * setup->inv_w[i];
+    }
+    setup->u_w = u_w[0];
+    setup->v_w = v_w[0];
+    plane_slopes(u_w, ab, ac, setup->inv_area, &setup->u_w_dx, &setup->u_w_dy);
+    plane_slopes(v_w, ab, ac, setup->inv_area, &setup->v_w_dx, &setup->v_w_dy);
+    plane_slopes(setup->inv_w, ab, ac, setup->inv_area, &setup->inv_w_dx, &setup->inv_w_dy);
+
+    setup->color = triangle->color;
+    setup->depth = triangle->avg_depth;
+    return true;
+}
 
-    float x_start = a.x;
-    float x_end = x_start;
-    for (int y = y_start; y <= y_end; y++) {
-        // If we're rotated the other way, lets swap so we are still drawing
-        // left to right
-        if (x_end < x_start) {
-            float_swap(&x_start, &x_end);
-            float_swap(&xstep_1, &xstep_2);
-        }
+// Rows can round a pixel past the vertices, so one pixel of margin
+static void mark_triangle_dirty(const triangle_setup_t *triangle) {
+    const float *x = triangle->x, *y = triangle->y;
+    mark_dirty_rect(floorf(fminf(x[0], fminf(x[1], x[2]))) - 1, floorf(y[0]) - 1,
+                    ceilf(fmaxf(x[0], fmaxf(x[1], x[2]))) + 1, ceilf(y[2]) + 1);
+}
 
-        // top-left raster rule
-        int x_left = floorf(x_start);
-        int x_right = ceilf(x_end) - 1;
-        for (int x = x_left; x <= x_right; x++) {
-            draw_w_pixel(x, y, a, b, c, triangle->color);
+// Depth plane stepped along the row, the only thing a flat color needs
+static void fill_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                     void *data) {
+    (void)data;
+    float inv_w = triangle_setup_plane(triangle, triangle->inv_w[0], triangle->inv_w_dx,
+                                       triangle->inv_w_dy, x_left, y);
+    for (int x = x_left; x <= x_right; x++) {
+        if (inv_w > w_buffer_at(x, y)) {
+            draw_pixel(x, y, triangle->color);
+            update_w_buffer(x, y, inv_w);
         }
-
-        x_start += xstep_1;
-        x_end += xstep_2;
+        inv_w += triangle->inv_w_dx;
     }
 }
 
-static void fill_flat_top_triangle(const triangle_t *triangle) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
-
-    float dx_1 = roundf(c.x) - roundf(b.x);
-    float dy_1 = roundf(c.y) - roundf(b.y);
-    float xstep_1 = dx_1 / dy_1;
+// Pixels the walks can reach, they run between rounded vertices
+typedef struct {
+    int x_min, y_min, x_max, y_max;
+} pixel_box_t;
+
+static pixel_box_t triangle_pixel_box(const triangle_setup_t *triangle) {
+    const float *x = triangle->x;
+    return (pixel_box_t){
+        .x_min = roundf(fminf(x[0], fminf(x[1], x[2]))),
+        .y_min = roundf(triangle->y[0]),
+        .x_max = roundf(fmaxf(x[0], fmaxf(x[1], x[2]))),
+        .y_max = roundf(triangle->y[2]),
+    };
+}
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
-    float xstep_2 = dx_2 / dy_2;
+static bool is_tiny(pixel_box_t box) {
+    return box.x_max - box.x_min < TRIANGLE_TINY_SIZE && box.y_max - box.y_min < TRIANGLE_TINY_SIZE;
+}
 
-    int y_start = roundf(c.y);
-    int y_end = roundf(b.y);
+// Every pixel in the box tested against the three edges instead of working out slopes. Same
+// pixels as walking, so neighbours still meet: edges run between rounded vertices and each row
+// reaches half a pixel past them, as rounding its ends does, which takes the upper pixel on a tie.
+// Whole numbers all the way, doubled to keep the half, so the test is exact. Convex, so the pixels
+// inside a row are always one run
+static void walk_tiny_triangle(const triangle_setup_t *triangle, pixel_box_t box,
+                               triangle_row_fn row, void *data) {
+    int width, height;
+    get_window_size(&width, &height);
+
+    int x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = roundf(triangle->x[i]);
+        y[i] = roundf(triangle->y[i]);
+    }
+    int side = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) < 0 ? -1 : 1;
+
+    box.x_min = box.x_min < 0 ? 0 : box.x_min;
+    box.y_min = box.y_min < 0 ? 0 : box.y_min;
+    box.x_max = box.x_max > width - 1 ? width - 1 : box.x_max;
+    box.y_max = box.y_max > height - 1 ? height - 1 : box.y_max;
+
+    // Doubled edge functions at the top left of the box, stepped by whole pixels from there
+    int step_x[3], step_y[3], start[3];
+    for (int i = 0; i < 3; i++) {
+        int next = i == 2 ? 0 : i + 1;
+        int a = side * (y[i] - y[next]);
+        int b = side * (x[next] - x[i]);
+        // Half a pixel of reach, a tie on an edge with the inside to its right goes outside
+        int reach = (a < 0 ? -a : a) - (a > 0);
+        start[i] = 2 * (a * (box.x_min - x[i]) + b * (box.y_min - y[i])) + reach;
+        step_x[i] = 2 * a;
+        step_y[i] = 2 * b;
+    }
 
-    float x_start = c.x;
-    float x_end = x_start;
-    for (int y = y_start; y >= y_end; y--) {
-        // If we're rotated the other way, lets swap so we are still drawing left to right
-        if (x_end < x_start) {
-            float_swap(&x_start, &x_end);
-            float_swap(&xstep_1, &xstep_2);
+    for (int py = box.y_min; py <= box.y_max; py++) {
+        int e0 = start[0], e1 = start[1], e2 = start[2];
+        int x_left = box.x_max + 1, x_right = box.x_min - 1;
+        for (int px = box.x_min; px <= box.x_max; px++) {
+            if ((e0 | e1 | e2) >= 0) {
+                x_left = px < x_left ? px : x_left;
+                x_right = px;
+            }
+            e0 += step_x[0];
+            e1 += step_x[1];
+            e2 += step_x[2];
         }
 
-        // top-left raster rule
-        int x_left = floorf(x_start);
-        int x_right = ceilf(x_end) - 1;
-        for (int x = x_left; x <= x_right; x++) {
-            draw_w_pixel(x, y, a, b, c, triangle->color);
-        }
+        if (x_left <= x_right)
+            row(triangle, py, x_left, x_right, data);
 
-        x_start -= xstep_1;
-        x_end -= xstep_2;
+        for (int i = 0; i < 3; i++) {
+            start[i] += step_y[i];
+        }
     }
 }
 
-// flat bottom flat top algorithm
-void draw_filled_triangle(triangle_t triangle) {
-    // already flat bottom
-    if (roundf(triangle.points[1].y) == roundf(triangle.points[2].y)) {
-        fill_flat_bottom_triangle(&triangle);
-        return;
-    }
-
-    // already flat top
-    if (roundf(triangle.points[0].y) == roundf(triangle.points[1].y)) {
-        fill_flat_top_triangle(&triangle);
+// Clipped to the screen here, so rows can index the buffers without checking every pixel
+static void walk_row(const triangle_setup_t *triangle, int y, float x_start, float x_end,
+                     triangle_row_fn row, void *data) {
+    int width, height;
+    get_window_size(&width, &height);
+    if (y < 0 || y >= height)
         return;
-    }
 
-    fill_flat_bottom_triangle(&triangle);
-    fill_flat_top_triangle(&triangle);
+    int x_left = roundf(x_start);
+    int x_right = roundf(x_end);
+    x_left = x_left < 0 ? 0 : x_left;
+    x_right = x_right > width - 1 ? width - 1 : x_right;
+    if (x_left <= x_right)
+        row(triangle, y, x_left, x_right, data);
 }
 
-static void affine_texture_flat_bottom_triangle(const triangle_t *triangle,
-                                                const texture_t *texture) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
-
-    tex2_t a_uv = triangle->tex_coords[0];
-    tex2_t b_uv = triangle->tex_coords[1];
-    tex2_t c_uv = triangle->tex_coords[2];
+static void walk_flat_bottom_triangle(const triangle_setup_t *triangle, triangle_row_fn row,
+                                      void *data) {
+    const float *px = triangle->x, *py = triangle->y;
 
-    float dx_1 = roundf(b.x) - roundf(a.x);
-    float dy_1 = roundf(b.y) - roundf(a.y);
+    float dx_1 = roundf(px[1]) - roundf(px[0]);
+    float dy_1 = roundf(py[1]) - roundf(py[0]);
     // inverse slope, for every 1 increment in y, how much to step in x?
     float xstep_1 = dx_1 / dy_1;
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
+    float dx_2 = roundf(px[2]) - roundf(px[0]);
+    float dy_2 = roundf(py[2]) - roundf(py[0]);
     // inverse slope, for every 1 increment in y, how much to step in x?
     float xstep_2 = dx_2 / dy_2;
 
-    float x_start = roundf(a.x);
+    int y_start = roundf(py[0]);
+    int y_end = roundf(py[1]);
+
+    float x_start = roundf(px[0]);
     float x_end = x_start;
-    for (int y = roundf(a.y); y <= roundf(b.y); y++) {
+    for (int y = y_start; y <= y_end; y++) {
         // If we're rotated the other way, lets swap so we are still drawing left to right
         if (x_end < x_start) {
             float_swap(&x_start, &x_end);
             float_swap(&xstep_1, &xstep_2);
         }
 
-        for (int x = roundf(x_start); x <= roundf(x_end); x++) {
-            if (texture == NULL) {
-                draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
-            } else {
-                draw_affine_texel(x, y, vec4_to_vec2(a), vec4_to_vec2(b), vec4_to_vec2(c), a_uv,
-                                  b_uv, c_uv, texture);
-            }
-        }
+        walk_row(triangle, y, x_start, x_end, row, data);
 
         x_start += xstep_1;
         x_end += xstep_2;
     }
 }
 
-static void affine_texture_flat_top_triangle(const triangle_t *triangle, const texture_t *texture) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
+static void walk_flat_top_triangle(const triangle_setup_t *triangle, triangle_row_fn row,
+                                   void *data) {
+    const float *px = triangle->x, *py = triangle->y;
 
-    tex2_t a_uv = triangle->tex_coords[0];
-    tex2_t b_uv = triangle->tex_coords[1];
-    tex2_t c_uv = triangle->tex_coords[2];
-
-    float dx_1 = roundf(c.x) - roundf(b.x);
-    float dy_1 = roundf(c.y) - roundf(b.y);
+    float dx_1 = roundf(px[2]) - roundf(px[1]);
+    float dy_1 = roundf(py[2]) - roundf(py[1]);
     float xstep_1 = dx_1 / dy_1;
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
+    float dx_2 = roundf(px[2]) - roundf(px[0]);
+    float dy_2 = roundf(py[2]) - roundf(py[0]);
     float xstep_2 = dx_2 / dy_2;
 
-    float x_start = roundf(c.x);
+    int y_start = roundf(py[2]);
+    int y_end = roundf(py[1]);
+
+    float x_start = roundf(px[2]);
     float x_end = x_start;
-    for (int y = roundf(c.y); y >= roundf(b.y); y--) {
+    for (int y = y_start; y >= y_end; y--) {
         // If we're rotated the other way, lets swap so we are still drawing left to right
         if (x_end < x_start) {
             float_swap(&x_start, &x_end);
             float_swap(&xstep_1, &xstep_2);
         }
 
-        for (int x = roundf(x_start); x <= roundf(x_end); x++) {
-            if (texture == NULL) {
-                draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
-            } else {
-                draw_affine_texel(x, y, vec4_to_vec2(a), vec4_to_vec2(b), vec4_to_vec2(c), a_uv,
-                                  b_uv, c_uv, texture);
-            }
-        }
+        walk_row(triangle, y, x_start, x_end, row, data);
 
         x_start -= xstep_1;
         x_end -= xstep_2;
     }
 }
 
-void draw_affine_textured_triangle(triangle_t triangle, const texture_t *texture) {
+// flat bottom flat top algorithm
+void triangle_walk_rows(const triangle_setup_t *triangle, triangle_row_fn row, void *data) {
+    pixel_box_t box = triangle_pixel_box(triangle);
+    if (is_tiny(box)) {
+        walk_tiny_triangle(triangle, box, row, data);
+        return;
+    }
+
     // already flat bottom
-    if (roundf(triangle.points[1].y) == roundf(triangle.points[2].y)) {
-        affine_texture_flat_bottom_triangle(&triangle, texture);
+    if (roundf(triangle->y[1]) == roundf(triangle->y[2])) {
+        walk_flat_bottom_triangle(triangle, row, data);
         return;
     }
 
     // already flat top
-    if (roundf(triangle.points[0].y) == roundf(triangle.points[1].y)) {
-        affine_texture_flat_top_triangle(&triangle, texture);
+    if (roundf(triangle->y[0]) == roundf(triangle->y[1])) {
+        walk_flat_top_triangle(triangle, row, data);
         return;
     }
 
-    affine_texture_flat_bottom_triangle(&triangle, texture);
-    affine_texture_flat_top_triangle(&triangle, texture);
+    walk_flat_bottom_triangle(triangle, row, data);
+    walk_flat_top_triangle(triangle, row, data);
 }
 
-static void texture_flat_bottom_triangle(const triangle_t *triangle, const texture_t *texture) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
+void draw_filled_triangle(const triangle_setup_t *triangle) {
+    mark_triangle_dirty(triangle);
+    triangle_walk_rows(triangle, fill_row, NULL);
+}
 
-    tex2_t a_uv = triangle->tex_coords[0];
-    tex2_t b_uv = triangle->tex_coords[1];
-    tex2_t c_uv = triangle->tex_coords[2];
+static void checker_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                        void *data) {
+    (void)triangle;
+    (void)data;
+    for (int x = x_left; x <= x_right; x++) {
+        draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
+    }
+}
 
-    float dx_1 = roundf(b.x) - roundf(a.x);
-    float dy_1 = roundf(b.y) - roundf(a.y);
-    // inverse slope, for every 1 increment in y, how much to step in x?
-    float xstep_1 = dx_1 / dy_1;
+// u and v themselves are planes for the affine mode, worked out per triangle as it is the only
+// mode that wants them
+typedef struct {
+    sampler_t sampler;
+    float u, v, u_dx, v_dx, u_dy, v_dy;
+} affine_row_t;
+
+// Fixed point texel coordinates step along the row, kind is a constant in every call so each
+// sampler gets a loop of its own. Unsigned steps wrap instead of overflowing on wild coordinates
+static inline void affine_texture_pixels(const affine_row_t *affine, sampler_kind_e kind, int y,
+                                         int x_left, int x_right, float u, float v) {
+    const sampler_t *sampler = &affine->sampler;
+    uint32_t tex_x = sampler_fixed(u, sampler->scale_u);
+    uint32_t tex_y = sampler_fixed(v, sampler->scale_v);
+    uint32_t tex_x_dx = sampler_fixed(affine->u_dx, sampler->scale_u);
+    uint32_t tex_y_dx = sampler_fixed(affine->v_dx, sampler->scale_v);
+    for (int x = x_left; x <= x_right; x++) {
+        draw_pixel(x, y, sampler_fetch(sampler, kind, (int32_t)tex_x, (int32_t)tex_y));
+        tex_x += tex_x_dx;
+        tex_y += tex_y_dx;
+    }
+}
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
-    // inverse slope, for every 1 increment in y, how much to step in x?
-    float xstep_2 = dx_2 / dy_2;
+static void affine_texture_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                               void *data) {
+    const affine_row_t *affine = data;
+    float u = triangle_setup_plane(triangle, affine->u, affine->u_dx, affine->u_dy, x_left, y);
+    float v = triangle_setup_plane(triangle, affine->v, affine->v_dx, affine->v_dy, x_left, y);
+    switch (affine->sampler.kind) {
+    case SAMPLER_NEAREST_POW2:
+        affine_texture_pixels(affine, SAMPLER_NEAREST_POW2, y, x_left, x_right, u, v);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT8:
+        affine_texture_pixels(affine, SAMPLER_NEAREST_POW2_CLUT8, y, x_left, x_right, u, v);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT4:
+        affine_texture_pixels(affine, SAMPLER_NEAREST_POW2_CLUT4, y, x_left, x_right, u, v);
+        break;
+    case SAMPLER_NEAREST:
+        affine_texture_pixels(affine, SAMPLER_NEAREST, y, x_left, x_right, u, v);
+        break;
+    case SAMPLER_BILINEAR:
+        affine_texture_pixels(affine, SAMPLER_BILINEAR, y, x_left, x_right, u, v);
+        break;
+    }
+}
 
-    int y_start = roundf(a.y);
-    int y_end = roundf(b.y);
+void draw_affine_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture) {
+    mark_triangle_dirty(triangle);
 
-    float x_start = roundf(a.x);
-    float x_end = x_start;
-    for (int y = y_start; y <= y_end; y++) {
-        // If we're rotated the other way, lets swap so we are still drawing left to right
-        if (x_end < x_start) {
-            float_swap(&x_start, &x_end);
-            float_swap(&xstep_1, &xstep_2);
-        }
+    if (texture == NULL || !texture_loaded(texture)) {
+        triangle_walk_rows(triangle, checker_row, NULL);
+        return;
+    }
 
-        for (int x = roundf(x_start); x <= roundf(x_end); x++) {
-            if (texture == NULL) {
-                draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
-            } else {
-                draw_texel(x, y, a, b, c, a_uv, b_uv, c_uv, texture);
-            }
-        }
+    vec2_t ab = {triangle->x[1] - triangle->x[0], triangle->y[1] - triangle->y[0]};
+    vec2_t ac = {triangle->x[2] - triangle->x[0], triangle->y[2] - triangle->y[0]};
+    float u[3] = {triangle->uv[0].u, triangle->uv[1].u, triangle->uv[2].u};
+    float v[3] = {triangle->uv[0].v, triangle->uv[1].v, triangle->uv[2].v};
 
-        x_start += xstep_1;
-        x_end += xstep_2;
-    }
+    affine_row_t affine = {.u = u[0], .v = v[0]};
+    sampler_init(&affine.sampler, texture, should_filter_bilinear());
+    plane_slopes(u, ab, ac, triangle->inv_area, &affine.u_dx, &affine.u_dy);
+    plane_slopes(v, ab, ac, triangle->inv_area, &affine.v_dx, &affine.v_dy);
+    triangle_walk_rows(triangle, affine_texture_row, &affine);
 }
 
-static void texture_flat_top_triangle(const triangle_t *triangle, const texture_t *texture) {
-    vec4_t a = triangle->points[0];
-    vec4_t b = triangle->points[1];
-    vec4_t c = triangle->points[2];
-
-    tex2_t a_uv = triangle->tex_coords[0];
-    tex2_t b_uv = triangle->tex_coords[1];
-    tex2_t c_uv = triangle->tex_coords[2];
+// Planes stepped along the row, a divide only for pixels that pass the depth test
+static inline void texture_pixels(const triangle_setup_t *triangle, const sampler_t *sampler,
+                                  sampler_kind_e kind, int y, int x_left, int x_right) {
+    float u_w = triangle_setup_plane(triangle, triangle->u_w, triangle->u_w_dx, triangle->u_w_dy,
+                                     x_left, y);
+    float v_w = triangle_setup_plane(triangle, triangle->v_w, triangle->v_w_dx, triangle->v_w_dy,
+                                     x_left, y);
+    float inv_w = triangle_setup_plane(triangle, triangle->inv_w[0], triangle->inv_w_dx,
+                                       triangle->inv_w_dy, x_left, y);
+
+    for (int x = x_left; x <= x_right; x++) {
+        // Only draw the pixel if depth value is greater (closer) than already there
+        // Remember 1/w will grow bigger when z is lower (closer)
+        if (inv_w > w_buffer_at(x, y)) {
+            float w = 1.0f / inv_w;
+            int32_t tex_x = sampler_fixed(u_w * w, sampler->scale_u);
+            int32_t tex_y = sampler_fixed(v_w * w, sampler->scale_v);
+            draw_pixel(x, y, sampler_fetch(sampler, kind, tex_x, tex_y));
+            update_w_buffer(x, y, inv_w);
+        }
+        u_w += triangle->u_w_dx;
+        v_w += triangle->v_w_dx;
+        inv_w += triangle->inv_w_dx;
+    }
+}
 
-    float dx_1 = roundf(c.x) - roundf(b.x);
-    float dy_1 = roundf(c.y) - roundf(b.y);
-    float xstep_1 = dx_1 / dy_1;
+static void texture_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                        void *data) {
+    const sampler_t *sampler = data;
+    switch (sampler->kind) {
+    case SAMPLER_NEAREST_POW2:
+        texture_pixels(triangle, sampler, SAMPLER_NEAREST_POW2, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT8:
+        texture_pixels(triangle, sampler, SAMPLER_NEAREST_POW2_CLUT8, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT4:
+        texture_pixels(triangle, sampler, SAMPLER_NEAREST_POW2_CLUT4, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST:
+        texture_pixels(triangle, sampler, SAMPLER_NEAREST, y, x_left, x_right);
+        break;
+    case SAMPLER_BILINEAR:
+        texture_pixels(triangle, sampler, SAMPLER_BILINEAR, y, x_left, x_right);
+        break;
+    }
+}
 
-    float dx_2 = roundf(c.x) - roundf(a.x);
-    float dy_2 = roundf(c.y) - roundf(a.y);
-    float xstep_2 = dx_2 / dy_2;
+void draw_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture) {
+    mark_triangle_dirty(triangle);
 
-    int y_start = roundf(c.y);
-    int y_end = roundf(b.y);
+    if (texture == NULL || !texture_loaded(texture)) {
+        triangle_walk_rows(triangle, checker_row, NULL);
+        return;
+    }
 
-    float x_start = roundf(c.x);
-    float x_end = x_start;
-    for (int y = y_start; y >= y_end; y--) {
-        // If we're rotated the other way, lets swap so we are still drawing left to right
-        if (x_end < x_start) {
-            float_swap(&x_start, &x_end);
-            float_swap(&xstep_1, &xstep_2);
-        }
+    sampler_t sampler;
+    sampler_init(&sampler, texture, should_filter_bilinear());
+    triangle_walk_rows(triangle, texture_row, &sampler);
+}
 
-        for (int x = roundf(x_start); x <= roundf(x_end); x++) {
-            if (texture == NULL) {
-                draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
-            } else {
-                draw_texel(x, y, a, b, c, a_uv, b_uv, c_uv, texture);
+typedef struct {
+    sampler_t sampler;
+    int span_length;
+} span_row_t;
+
+// One row, only the ends of every span pay for a divide, the pixels in between step fixed point
+// texel coordinates linearly, which is all the eye can tell apart at 16 pixels
+static inline void span_texture_pixels(const triangle_setup_t *triangle, const span_row_t *span,
+                                       sampler_kind_e kind, int y, int x_left, int x_right) {
+    const sampler_t *sampler = &span->sampler;
+    int span_length = span->span_length;
+
+    float u_w = triangle_setup_plane(triangle, triangle->u_w, triangle->u_w_dx, triangle->u_w_dy,
+                                     x_left, y);
+    float v_w = triangle_setup_plane(triangle, triangle->v_w, triangle->v_w_dx, triangle->v_w_dy,
+                                     x_left, y);
+    float inv_w = triangle_setup_plane(triangle, triangle->inv_w[0], triangle->inv_w_dx,
+                                       triangle->inv_w_dy, x_left, y);
+
+    float w = 1.0f / inv_w;
+    float u = u_w * w, v = v_w * w;
+
+    float inv_span = 1.0f / span_length;
+    for (int x = x_left; x <= x_right;) {
+        int length = x_right - x + 1 < span_length ? x_right - x + 1 : span_length;
+
+        // Exact at the far end of the span, which is also where the next one starts
+        float end_u_w = u_w + triangle->u_w_dx * length;
+        float end_v_w = v_w + triangle->v_w_dx * length;
+        float end_inv_w = inv_w + triangle->inv_w_dx * length;
+        float end_w = 1.0f / end_inv_w;
+        float end_u = end_u_w * end_w, end_v = end_v_w * end_w;
+
+        float step = length == span_length ? inv_span : 1.0f / length;
+        uint32_t tex_x = sampler_fixed(u, sampler->scale_u);
+        uint32_t tex_y = sampler_fixed(v, sampler->scale_v);
+        uint32_t tex_x_dx = sampler_fixed((end_u - u) * step, sampler->scale_u);
+        uint32_t tex_y_dx = sampler_fixed((end_v - v) * step, sampler->scale_v);
+
+        // 1/w stays exact, it is linear anyway, so depth testing does not change
+        float pixel_inv_w = inv_w;
+        for (int i = 0; i < length; i++, x++) {
+            if (pixel_inv_w > w_buffer_at(x, y)) {
+                draw_pixel(x, y, sampler_fetch(sampler, kind, (int32_t)tex_x, (int32_t)tex_y));
+                update_w_buffer(x, y, pixel_inv_w);
             }
+            tex_x += tex_x_dx;
+            tex_y += tex_y_dx;
+            pixel_inv_w += triangle->inv_w_dx;
         }
 
-        x_start -= xstep_1;
-        x_end -= xstep_2;
+        u_w = end_u_w;
+        v_w = end_v_w;
+        inv_w = end_inv_w;
+        u = end_u;
+        v = end_v;
     }
 }
 
-void draw_textured_triangle(triangle_t triangle, const texture_t *texture) {
-    // already flat bottom
-    if (roundf(triangle.points[1].y) == roundf(triangle.points[2].y)) {
-        texture_flat_bottom_triangle(&triangle, texture);
-        return;
+static void span_texture_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                             void *data) {
+    const span_row_t *span = data;
+    switch (span->sampler.kind) {
+    case SAMPLER_NEAREST_POW2:
+        span_texture_pixels(triangle, span, SAMPLER_NEAREST_POW2, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT8:
+        span_texture_pixels(triangle, span, SAMPLER_NEAREST_POW2_CLUT8, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST_POW2_CLUT4:
+        span_texture_pixels(triangle, span, SAMPLER_NEAREST_POW2_CLUT4, y, x_left, x_right);
+        break;
+    case SAMPLER_NEAREST:
+        span_texture_pixels(triangle, span, SAMPLER_NEAREST, y, x_left, x_right);
+        break;
+    case SAMPLER_BILINEAR:
+        span_texture_pixels(triangle, span, SAMPLER_BILINEAR, y, x_left, x_right);
+        break;
     }
+}
 
-    // already flat top
-    if (roundf(triangle.points[0].y) == roundf(triangle.points[1].y)) {
-        texture_flat_top_triangle(&triangle, texture);
+void draw_span_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture,
+                                 int span_length) {
+    // Same coverage as draw_textured_triangle, so the checker stands in for a missing texture
+    if (texture == NULL || !texture_loaded(texture)) {
+        draw_textured_triangle(triangle, NULL);
         return;
     }
 
-    texture_flat_bottom_triangle(&triangle, texture);
-    texture_flat_top_triangle(&triangle, texture);
+    mark_triangle_dirty(triangle);
+    span_row_t span = {.span_length = span_length};
+    sampler_init(&span.sampler, texture, should_filter_bilinear());
+    triangle_walk_rows(triangle, span_texture_row, &span);
+}
+
+void draw_mesh_triangles(const triangle_setup_t *triangles, int num_triangles,
+                         const texture_t *texture) {
+    for (int i = 0; i < num_triangles; i++) {
+        // Already sorted top to bottom, read in place
+        const triangle_setup_t *triangle = &triangles[i];
+
+        // Draw Textured Triangles
+        if (should_render_texture()) {
+            draw_textured_triangle(triangle, texture);
+        }
+
+        // Draw Filled Triangles
+        if (should_render_fill()) {
+            draw_filled_triangle(triangle);
+        }
+
+        // SECRET!
+        if (should_render_ps1()) {
+            draw_affine_textured_triangle(triangle, texture);
+        }
+
+        // Exact every few pixels, linear in between
+        if (should_render_span_texture()) {
+            draw_span_textured_triangle(triangle, texture, texture_span_length());
+        }
+    }
 }
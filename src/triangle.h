@@ -5,9 +5,15 @@
 #include "texture.h"
 #include "vector.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+// Twice the area in square pixels below which a triangle is only a line
+#define TRIANGLE_MIN_AREA 1e-6f
+// Pixels across, below which testing every pixel center in the box beats walking the edges
+#define TRIANGLE_TINY_SIZE 4
+
 // Face vertices index, clockwise
 typedef struct {
     int a;
@@ -38,16 +44,61 @@ typedef struct {
     float avg_depth;
 } triangle_t;
 
+// Everything the rasterizer needs of one screen space triangle, worked out once when it is emitted.
+// Vertices are sorted top to bottom and u/w, v/w and 1/w are planes anchored at the top one, so a
+// pixel costs a few adds. Exactly two cache lines, the raster loops read it in place by pointer
+typedef struct {
+    float x[3], y[3];           // screen position, sorted by y
+    float inv_w[3];             // 1/w of every vertex, the depth plane starts at inv_w[0]
+    float edge_a[3], edge_b[3]; // edge from vertex i to the next, a * (x - x[i]) + b * (y - y[i])
+                                // is positive inside whichever way the triangle winds
+    tex2_t uv[3];               // for the affine mode, everything else uses the planes
+    float u_w, v_w;             // at the top vertex
+    float u_w_dx, v_w_dx, inv_w_dx;
+    float u_w_dy, v_w_dy, inv_w_dy;
+    float inv_area; // 1 / twice the signed area, for planes of anything else across the triangle
+    color_t color;
+    float depth; // painter's sort key, bigger is further away
+} triangle_setup_t;
+
 vec3_t triangle_normal(vec3_t points[3]);
 
+// Setup record of a projected triangle, in any vertex order. False if it could never draw a pixel,
+// it has no area or no pixel center in its bounding box
+bool triangle_setup_init(triangle_setup_t *setup, const triangle_t *triangle);
+
+// Value of the plane through base at the top vertex, at pixel x, y
+static inline float triangle_setup_plane(const triangle_setup_t *setup, float base, float dx,
+                                         float dy, float x, float y) {
+    return base + dx * (x - setup->x[0]) + dy * (y - setup->y[0]);
+}
+
+// Called for every row a triangle covers, already clipped to the screen
+typedef void (*triangle_row_fn)(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                                void *data);
+
+// The rounded vertex to vertex walk the textured modes share, so they all cover the same pixels.
+// Tiny triangles only cover the pixel centers inside their edges
+void triangle_walk_rows(const triangle_setup_t *triangle, triangle_row_fn row, void *data);
+
 int triangle_painter_compare(const void *t1, const void *t2);
 
 void sort_triangle_by_y(triangle_t *triangle);
 
-void draw_filled_triangle(triangle_t triangle);
+void draw_filled_triangle(const triangle_setup_t *triangle);
+
+void draw_affine_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture);
+
+void draw_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture);
 
-void draw_affine_textured_triangle(triangle_t triangle, const texture_t *texture);
+// Perspective correct only every span_length pixels along a row, affine in between, like the
+// software renderers of old. Within a pixel of draw_textured_triangle for a fraction of the divides
+void draw_span_textured_triangle(const triangle_setup_t *triangle, const texture_t *texture,
+                                 int span_length);
 
-void draw_textured_triangle(triangle_t triangle, const texture_t *texture);
+// Every triangle of one mesh the way the current render mode draws them, except the visibility
+// mode which goes through visibility_draw_triangle
+void draw_mesh_triangles(const triangle_setup_t *triangles, int num_triangles,
+                         const texture_t *texture);
 
 #endif
@@ -1,6 +1,12 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <math.h>
+
+#include "simd.h"
+
+// Header only so every call inlines into the hot loops, no LTO needed
+
 typedef struct {
     float x, y;
 } vec2_t;
@@ -13,35 +19,190 @@ typedef struct {
     float x, y, z, w;
 } vec4_t;
 
+// Structure of arrays, one array per component, for the batch functions
+typedef struct {
+    float *x, *y, *z;
+} vec3_soa_t;
+
+typedef struct {
+    float *x, *y, *z, *w;
+} vec4_soa_t;
+
 // 2d functions
-float vec2_length(vec2_t v);
-vec2_t vec2_add(vec2_t v1, vec2_t v2);
-vec2_t vec2_sub(vec2_t v1, vec2_t v2);
-vec2_t vec2_mul(vec2_t v, float s);
-vec2_t vec2_div(vec2_t v, float s);
-float vec2_dot(vec2_t a, vec2_t b);
-void vec2_normalize(vec2_t *v);
+static inline float vec2_length(vec2_t v) { return sqrtf(v.x * v.x + v.y * v.y); }
+
+static inline vec2_t vec2_add(vec2_t v1, vec2_t v2) {
+    vec2_t result = {
+        v1.x + v2.x,
+        v1.y + v2.y,
+    };
+    return result;
+}
+
+static inline vec2_t vec2_sub(vec2_t v1, vec2_t v2) {
+    vec2_t result = {
+        v1.x - v2.x,
+        v1.y - v2.y,
+    };
+    return result;
+}
+
+static inline vec2_t vec2_mul(vec2_t v, float s) {
+    vec2_t result = {
+        v.x * s,
+        v.y * s,
+    };
+    return result;
+}
+
+static inline vec2_t vec2_div(vec2_t v, float s) {
+    vec2_t result = {
+        v.x / s,
+        v.y / s,
+    };
+    return result;
+}
+
+static inline float vec2_dot(vec2_t a, vec2_t b) { return a.x * b.x + a.y * b.y; }
+
+static inline void vec2_normalize(vec2_t *v) { *v = vec2_div(*v, vec2_length(*v)); }
+
 // No such literal math thing as 2D cross product but useful in practice, just determinant really
-float vec2_cross(vec2_t a, vec2_t b);
+static inline float vec2_cross(vec2_t a, vec2_t b) { return a.x * b.y - a.y * b.x; }
 
 // 3d functions
-float vec3_length(vec3_t v);
-vec3_t vec3_add(vec3_t v1, vec3_t v2);
-vec3_t vec3_sub(vec3_t v1, vec3_t v2);
-vec3_t vec3_mul(vec3_t v, float s);
-vec3_t vec3_div(vec3_t v, float s);
-vec3_t vec3_cross(vec3_t a, vec3_t b);
-float vec3_dot(vec3_t a, vec3_t b);
-void vec3_normalize(vec3_t *v);
+static inline float vec3_length(vec3_t v) { return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z); }
 
-vec3_t vec3_rotate_x(vec3_t v, float angle);
-vec3_t vec3_rotate_y(vec3_t v, float angle);
-vec3_t vec3_rotate_z(vec3_t v, float angle);
+static inline vec3_t vec3_add(vec3_t v1, vec3_t v2) {
+    vec3_t result = {
+        v1.x + v2.x,
+        v1.y + v2.y,
+        v1.z + v2.z,
+    };
+    return result;
+}
 
-vec4_t vec3_to_vec4(vec3_t v);
+static inline vec3_t vec3_sub(vec3_t v1, vec3_t v2) {
+    vec3_t result = {
+        v1.x - v2.x,
+        v1.y - v2.y,
+        v1.z - v2.z,
+    };
+    return result;
+}
+
+static inline vec3_t vec3_mul(vec3_t v, float s) {
+    vec3_t result = {
+        v.x * s,
+        v.y * s,
+        v.z * s,
+    };
+    return result;
+}
+
+static inline vec3_t vec3_div(vec3_t v, float s) {
+    vec3_t result = {
+        v.x / s,
+        v.y / s,
+        v.z / s,
+    };
+    return result;
+}
+
+static inline vec3_t vec3_cross(vec3_t a, vec3_t b) {
+    vec3_t result = {
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x,
+    };
+    return result;
+}
+
+static inline float vec3_dot(vec3_t a, vec3_t b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+static inline void vec3_normalize(vec3_t *v) { *v = vec3_div(*v, vec3_length(*v)); }
+
+static inline vec3_t vec3_rotate_x(vec3_t v, float angle) {
+    vec3_t result = {
+        v.x,
+        v.y * cosf(angle) - v.z * sinf(angle),
+        v.y * sinf(angle) + v.z * cosf(angle),
+    };
+    return result;
+}
+
+static inline vec3_t vec3_rotate_y(vec3_t v, float angle) {
+    vec3_t result = {
+        v.x * cosf(angle) - v.z * sinf(angle),
+        v.y,
+        v.x * sinf(angle) + v.z * cosf(angle),
+    };
+    return result;
+}
+
+static inline vec3_t vec3_rotate_z(vec3_t v, float angle) {
+    vec3_t result = {
+        v.x * cosf(angle) - v.y * sinf(angle),
+        v.x * sinf(angle) + v.y * cosf(angle),
+        v.z,
+    };
+    return result;
+}
+
+static inline vec4_t vec3_to_vec4(vec3_t v) {
+    vec4_t result = {
+        v.x,
+        v.y,
+        v.z,
+        1.0f,
+    };
+    return result;
+}
 
 // 4d functions
-vec3_t vec4_to_vec3(vec4_t v);
-vec2_t vec4_to_vec2(vec4_t v);
+static inline vec3_t vec4_to_vec3(vec4_t v) {
+    vec3_t result = {
+        v.x,
+        v.y,
+        v.z,
+    };
+    return result;
+}
+
+static inline vec2_t vec4_to_vec2(vec4_t v) {
+    vec2_t result = {
+        v.x,
+        v.y,
+    };
+    return result;
+}
+
+// Batch functions
+
+// out[i] = dot(a[i], b) for count vectors
+static inline void vec3_dot_soa(vec3_soa_t a, vec3_t b, float *out, int count) {
+    int i = 0;
+#if defined(SIMD_AVX)
+    __m256 bx8 = _mm256_set1_ps(b.x), by8 = _mm256_set1_ps(b.y), bz8 = _mm256_set1_ps(b.z);
+    for (; i + 8 <= count; i += 8) {
+        __m256 dot = _mm256_mul_ps(_mm256_loadu_ps(a.x + i), bx8);
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(a.y + i), by8));
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(a.z + i), bz8));
+        _mm256_storeu_ps(out + i, dot);
+    }
+#endif
+#if defined(SIMD_SSE)
+    __m128 bx = _mm_set1_ps(b.x), by = _mm_set1_ps(b.y), bz = _mm_set1_ps(b.z);
+    for (; i + 4 <= count; i += 4) {
+        __m128 dot = _mm_mul_ps(_mm_loadu_ps(a.x + i), bx);
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(a.y + i), by));
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(a.z + i), bz));
+        _mm_storeu_ps(out + i, dot);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = a.x[i] * b.x + a.y[i] * b.y + a.z[i] * b.z;
+    }
+}
 
 #endif
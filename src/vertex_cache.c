@@ -0,0 +1,241 @@
+#include "vertex_cache.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+// Forsyth's scoring. The last face's vertices get a flat score, so the next face doesn't just
+// share an edge with it, further back in the cache the score decays. Vertices with few faces left
+// get a boost so they are finished off instead of left behind as lone faces
+#define LAST_FACE_SCORE 0.75f
+#define CACHE_DECAY_POWER 1.5f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define VALENCE_TABLE_SIZE 32
+
+typedef struct {
+    float cache[VERTEX_CACHE_SIZE];     // by position in the cache
+    float valence[VALENCE_TABLE_SIZE]; // by faces left to draw
+} score_tables_t;
+
+static void score_tables_init(score_tables_t *tables) {
+    for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+        float decay = 1.0f - (float)(i - 3) / (VERTEX_CACHE_SIZE - 3);
+        tables->cache[i] = i < 3 ? LAST_FACE_SCORE : powf(decay, CACHE_DECAY_POWER);
+    }
+    tables->valence[0] = 0.0f;
+    for (int i = 1; i < VALENCE_TABLE_SIZE; i++) {
+        tables->valence[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+}
+
+// cache_position is -1 when the vertex isn't in the cache
+static float vertex_score(const score_tables_t *tables, int cache_position, int faces_left) {
+    // Nothing left to draw with it
+    if (faces_left == 0)
+        return -1.0f;
+
+    float score = cache_position >= 0 ? tables->cache[cache_position] : 0.0f;
+    if (faces_left < VALENCE_TABLE_SIZE)
+        return score + tables->valence[faces_left];
+    return score + VALENCE_BOOST_SCALE * powf((float)faces_left, -VALENCE_BOOST_POWER);
+}
+
+// Swaps the face out of the ones a vertex still has to draw
+static void remove_face(int *vertex_faces, int *faces_left, int face) {
+    for (int i = 0; i < *faces_left; i++) {
+        if (vertex_faces[i] == face) {
+            vertex_faces[i] = vertex_faces[--*faces_left];
+            return;
+        }
+    }
+}
+
+static bool cache_contains(const int *cache, int count, int vertex) {
+    for (int i = 0; i < count; i++) {
+        if (cache[i] == vertex)
+            return true;
+    }
+    return false;
+}
+
+// Misses per face fetching every vertex index shifted down by shift through a fifo of size
+static float fifo_misses(const face_t *faces, int num_faces, int num_vertices, int shift,
+                         int size) {
+    // A slot is still in the fifo while fewer than size misses have come after its own. Starting
+    // every slot that far back has them all miss the first time
+    int num_slots = (num_vertices >> shift) + 1;
+    int *missed_at = malloc(sizeof(int) * num_slots);
+    for (int i = 0; i < num_slots; i++) {
+        missed_at[i] = -size - 1;
+    }
+
+    int misses = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+        for (int j = 0; j < 3; j++) {
+            int slot = corners[j] >> shift;
+            if (misses - missed_at[slot] > size)
+                missed_at[slot] = misses++;
+        }
+    }
+    free(missed_at);
+
+    return (float)misses / num_faces;
+}
+
+vertex_cache_locality_t vertex_cache_measure(const face_t *faces, int num_vertices) {
+    vertex_cache_locality_t locality = {0};
+    int num_faces = array_size((void *)faces);
+    if (num_faces == 0 || num_vertices == 0)
+        return locality;
+
+    locality.acmr = fifo_misses(faces, num_faces, num_vertices, 0, VERTEX_CACHE_SIZE);
+    locality.line_misses = fifo_misses(faces, num_faces, num_vertices, VERTEX_CACHE_LINE_SHIFT,
+                                       VERTEX_CACHE_LINES);
+    return locality;
+}
+
+void vertex_cache_optimize(vec3_t *vertices, face_t *faces) {
+    int num_vertices = array_size(vertices);
+    int num_faces = array_size(faces);
+    if (num_faces == 0)
+        return;
+
+    // Every vertex's faces, the first faces_left of its slice are the ones not drawn yet
+    int *faces_left = calloc(num_vertices, sizeof(int));
+    int *adjacent_offsets = malloc(sizeof(int) * (num_vertices + 1));
+    int *adjacent = malloc(sizeof(int) * 3 * num_faces);
+    int *cache_position = malloc(sizeof(int) * num_vertices);
+    float *vertex_scores = malloc(sizeof(float) * num_vertices);
+    uint8_t *drawn = calloc(num_faces, sizeof(uint8_t));
+    face_t *ordered = malloc(sizeof(face_t) * num_faces);
+
+    for (int i = 0; i < num_faces; i++) {
+        faces_left[faces[i].a]++;
+        faces_left[faces[i].b]++;
+        faces_left[faces[i].c]++;
+    }
+    adjacent_offsets[0] = 0;
+    for (int i = 0; i < num_vertices; i++) {
+        adjacent_offsets[i + 1] = adjacent_offsets[i] + faces_left[i];
+        cache_position[i] = adjacent_offsets[i]; // where the next of its faces goes, for now
+    }
+    for (int i = 0; i < num_faces; i++) {
+        adjacent[cache_position[faces[i].a]++] = i;
+        adjacent[cache_position[faces[i].b]++] = i;
+        adjacent[cache_position[faces[i].c]++] = i;
+    }
+
+    score_tables_t tables;
+    score_tables_init(&tables);
+    for (int i = 0; i < num_vertices; i++) {
+        cache_position[i] = -1;
+        vertex_scores[i] = vertex_score(&tables, -1, faces_left[i]);
+    }
+
+    // Room for a face's worth of vertices past the end, pushed out as soon as they go in
+    int cache[VERTEX_CACHE_SIZE + 3], next_cache[VERTEX_CACHE_SIZE + 3];
+    int cache_count = 0;
+    int best = -1;
+    int next_undrawn = 0;
+    for (int n = 0; n < num_faces; n++) {
+        // Nothing in the cache has faces left, carry on from the first face not drawn yet
+        if (best < 0) {
+            while (drawn[next_undrawn])
+                next_undrawn++;
+            best = next_undrawn;
+        }
+
+        face_t face = faces[best];
+        ordered[n] = face;
+        drawn[best] = 1;
+        int corners[3] = {face.a, face.b, face.c};
+        for (int j = 0; j < 3; j++) {
+            int vertex = corners[j];
+            remove_face(&adjacent[adjacent_offsets[vertex]], &faces_left[vertex], best);
+        }
+
+        // The face's vertices go to the front, everything else moves back one face's worth
+        int next_count = 0;
+        for (int j = 0; j < 3; j++) {
+            if (!cache_contains(next_cache, next_count, corners[j]))
+                next_cache[next_count++] = corners[j];
+        }
+        for (int i = 0; i < cache_count; i++) {
+            if (!cache_contains(corners, 3, cache[i]))
+                next_cache[next_count++] = cache[i];
+        }
+
+        for (int i = 0; i < next_count; i++) {
+            int vertex = next_cache[i];
+            cache_position[vertex] = i < VERTEX_CACHE_SIZE ? i : -1;
+            vertex_scores[vertex] =
+                vertex_score(&tables, cache_position[vertex], faces_left[vertex]);
+        }
+
+        // The best face of any vertex still in the cache goes next, scored from its vertices as
+        // they are now
+        cache_count = next_count < VERTEX_CACHE_SIZE ? next_count : VERTEX_CACHE_SIZE;
+        best = -1;
+        float best_score = 0.0f;
+        for (int i = 0; i < cache_count; i++) {
+            int vertex = next_cache[i];
+            const int *vertex_faces = &adjacent[adjacent_offsets[vertex]];
+            for (int j = 0; j < faces_left[vertex]; j++) {
+                const face_t *candidate = &faces[vertex_faces[j]];
+                float score = vertex_scores[candidate->a] + vertex_scores[candidate->b] +
+                              vertex_scores[candidate->c];
+                if (best < 0 || score > best_score) {
+                    best = vertex_faces[j];
+                    best_score = score;
+                }
+            }
+        }
+
+        memcpy(cache, next_cache, sizeof(int) * cache_count);
+    }
+
+    // First use order, so the faces fetch vertices front to back. Reuses cache_position as the
+    // new index of every vertex
+    int *remap = cache_position;
+    for (int i = 0; i < num_vertices; i++) {
+        remap[i] = -1;
+    }
+    int next_index = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int corners[3] = {ordered[i].a, ordered[i].b, ordered[i].c};
+        for (int j = 0; j < 3; j++) {
+            if (remap[corners[j]] < 0)
+                remap[corners[j]] = next_index++;
+        }
+    }
+    for (int i = 0; i < num_vertices; i++) {
+        if (remap[i] < 0)
+            remap[i] = next_index++;
+    }
+
+    vec3_t *moved = malloc(sizeof(vec3_t) * num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        moved[remap[i]] = vertices[i];
+    }
+    memcpy(vertices, moved, sizeof(vec3_t) * num_vertices);
+    for (int i = 0; i < num_faces; i++) {
+        faces[i] = ordered[i];
+        faces[i].a = remap[ordered[i].a];
+        faces[i].b = remap[ordered[i].b];
+        faces[i].c = remap[ordered[i].c];
+    }
+
+    free(moved);
+    free(faces_left);
+    free(adjacent_offsets);
+    free(adjacent);
+    free(cache_position);
+    free(vertex_scores);
+    free(drawn);
+    free(ordered);
+}
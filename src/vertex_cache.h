@@ -0,0 +1,25 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include "triangle.h"
+#include "vector.h"
+
+#define VERTEX_CACHE_SIZE 32      // entries of the cache the order is tuned for and measured with
+#define VERTEX_CACHE_LINE_SHIFT 4 // 16 vertices to a 64 byte line of each structure of arrays
+#define VERTEX_CACHE_LINES 64     // lines of each array measured as if they stayed in cache
+
+// How well faces drawn in order reuse the vertices the ones before them fetched
+typedef struct {
+    float acmr;        // misses per face through a fifo of VERTEX_CACHE_SIZE, about 0.5 at best
+    float line_misses; // the same for lines of vertices through a fifo of VERTEX_CACHE_LINES
+} vertex_cache_locality_t;
+
+vertex_cache_locality_t vertex_cache_measure(const face_t *faces, int num_vertices);
+
+// Reorders the faces so each reuses vertices that were fetched recently (Forsyth's linear speed
+// vertex cache optimisation), then renumbers the vertices in the order the faces first use them
+// so fetching them streams through memory. Both dynamic arrays keep their sizes, vertices no
+// face uses go last
+void vertex_cache_optimize(vec3_t *vertices, face_t *faces);
+
+#endif
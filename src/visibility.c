@@ -0,0 +1,159 @@
+#include "visibility.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "array.h"
+#include "display.h"
+#include "sampler.h"
+
+void visibility_init(visibility_t *visibility) {
+    get_window_size(&visibility->width, &visibility->height);
+
+    int num_pixels = visibility->width * visibility->height;
+    visibility->depth = array_hold(visibility->depth, num_pixels, sizeof(float));
+    visibility->ids = array_hold(visibility->ids, num_pixels, sizeof(uint32_t));
+    array_tag(visibility->depth, MEMORY_DEPTH_BUFFER, MEMORY_NO_ASSET);
+    array_tag(visibility->ids, MEMORY_DEPTH_BUFFER, MEMORY_NO_ASSET);
+
+    // Everything dirty once, so the first clear covers the whole buffer
+    visibility->x_min = 0;
+    visibility->y_min = 0;
+    visibility->x_max = visibility->width - 1;
+    visibility->y_max = visibility->height - 1;
+    visibility_clear(visibility);
+}
+
+void visibility_clear(visibility_t *visibility) {
+    // Only what was drawn last frame
+    int row_size = visibility->x_max - visibility->x_min + 1;
+    for (int y = visibility->y_min; y <= visibility->y_max; y++) {
+        int row = y * visibility->width + visibility->x_min;
+        memset(&visibility->depth[row], 0, row_size * sizeof(float));
+        memset(&visibility->ids[row], 0xFF, row_size * sizeof(uint32_t)); // VISIBILITY_EMPTY
+    }
+
+    visibility->x_min = visibility->width;
+    visibility->y_min = visibility->height;
+    visibility->x_max = -1;
+    visibility->y_max = -1;
+    array_reset(visibility->meshes);
+    array_reset(visibility->triangle_meshes);
+}
+
+int visibility_add_mesh(visibility_t *visibility, const triangle_setup_t *triangles,
+                        int num_triangles, const texture_t *texture) {
+    static bool reported = false;
+    int first = array_size(visibility->triangle_meshes);
+    if (num_triangles > VISIBILITY_MAX_TRIANGLES - first) {
+        if (!reported)
+            fprintf(stderr, "Error drawing through the visibility buffer, over %d triangles\n",
+                    VISIBILITY_MAX_TRIANGLES);
+        reported = true;
+        return -1;
+    }
+
+    int mesh = array_size(visibility->meshes);
+    visibility_mesh_t entry = {.triangles = triangles, .texture = texture, .first = first};
+    array_push(visibility->meshes, entry);
+
+    // One mesh index per triangle, so resolving an id never has to search for its mesh
+    visibility->triangle_meshes =
+        array_hold(visibility->triangle_meshes, num_triangles, sizeof(int));
+    for (int i = 0; i < num_triangles; i++) {
+        visibility->triangle_meshes[first + i] = mesh;
+    }
+    return mesh;
+}
+
+typedef struct {
+    visibility_t *visibility;
+    uint32_t id;
+} id_row_t;
+
+static void draw_id_row(const triangle_setup_t *triangle, int y, int x_left, int x_right,
+                        void *data) {
+    const id_row_t *row = data;
+    visibility_t *visibility = row->visibility;
+
+    visibility->x_min = x_left < visibility->x_min ? x_left : visibility->x_min;
+    visibility->x_max = x_right > visibility->x_max ? x_right : visibility->x_max;
+    visibility->y_min = y < visibility->y_min ? y : visibility->y_min;
+    visibility->y_max = y > visibility->y_max ? y : visibility->y_max;
+
+    // 1/w is linear in screen space, one add per pixel
+    float inv_w = triangle_setup_plane(triangle, triangle->inv_w[0], triangle->inv_w_dx,
+                                       triangle->inv_w_dy, x_left, y);
+    float *depth = &visibility->depth[y * visibility->width];
+    uint32_t *ids = &visibility->ids[y * visibility->width];
+    for (int x = x_left; x <= x_right; x++) {
+        if (inv_w > depth[x]) {
+            depth[x] = inv_w;
+            ids[x] = row->id;
+        }
+        inv_w += triangle->inv_w_dx;
+    }
+}
+
+void visibility_draw_triangle(visibility_t *visibility, int mesh, int triangle) {
+    if (mesh < 0)
+        return;
+
+    id_row_t row = {
+        .visibility = visibility,
+        .id = (uint32_t)(visibility->meshes[mesh].first + triangle),
+    };
+    triangle_walk_rows(&visibility->meshes[mesh].triangles[triangle], draw_id_row, &row);
+}
+
+void visibility_resolve(const visibility_t *visibility) {
+    mark_dirty_rect(visibility->x_min, visibility->y_min, visibility->x_max, visibility->y_max);
+
+    // Neighbouring pixels mostly share a triangle, so it is only looked up again when it changes
+    uint32_t current = VISIBILITY_EMPTY;
+    const texture_t *texture = NULL;
+    const triangle_setup_t *t = NULL;
+    sampler_t sampler = {0};
+    bool bilinear = should_filter_bilinear();
+
+    for (int y = visibility->y_min; y <= visibility->y_max; y++) {
+        const uint32_t *ids = &visibility->ids[y * visibility->width];
+
+        for (int x = visibility->x_min; x <= visibility->x_max; x++) {
+            uint32_t id = ids[x];
+            if (id == VISIBILITY_EMPTY)
+                continue;
+
+            if (id != current) {
+                const visibility_mesh_t *mesh =
+                    &visibility->meshes[visibility->triangle_meshes[id]];
+                t = &mesh->triangles[id - mesh->first];
+                if (mesh->texture != texture && mesh->texture != NULL)
+                    sampler_init(&sampler, mesh->texture, bilinear);
+                texture = mesh->texture;
+                current = id;
+            }
+
+            if (texture == NULL || !texture_loaded(texture)) {
+                draw_pixel(x, y, (x % 2 && y % 2) ? PURPLE : BLACK);
+                continue;
+            }
+
+            // The only divide a pixel pays, whatever was drawn over it before
+            float w = 1.0f / triangle_setup_plane(t, t->inv_w[0], t->inv_w_dx, t->inv_w_dy, x, y);
+            float u = triangle_setup_plane(t, t->u_w, t->u_w_dx, t->u_w_dy, x, y) * w;
+            float v = triangle_setup_plane(t, t->v_w, t->v_w_dx, t->v_w_dy, x, y) * w;
+            draw_pixel(x, y, sampler_sample(&sampler, u, v));
+        }
+    }
+}
+
+void visibility_free(visibility_t *visibility) {
+    array_free(visibility->depth);
+    array_free(visibility->ids);
+    array_free(visibility->meshes);
+    array_free(visibility->triangle_meshes);
+
+    memset(visibility, 0, sizeof(visibility_t));
+}
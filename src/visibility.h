@@ -0,0 +1,53 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "texture.h"
+#include "triangle.h"
+
+// Every id is the index of a triangle among all the ones drawn this frame, whatever the number of
+// meshes they came from
+#define VISIBILITY_MAX_TRIANGLES INT_MAX
+#define VISIBILITY_EMPTY 0xFFFFFFFFu
+
+// What the ids of one mesh point back to
+typedef struct {
+    const triangle_setup_t *triangles; // exactly as they were drawn
+    const texture_t *texture;
+    int first; // id of its first triangle
+} visibility_mesh_t;
+
+// Two pass textured rendering. The first only finds the nearest triangle of every pixel, the
+// second shades each covered pixel once from it, so overdraw costs a depth test and no texel
+typedef struct {
+    int width, height;
+    float *depth;                   // dynamic array, 1/w of the nearest triangle, 0 if none
+    uint32_t *ids;                  // dynamic array, id of the nearest triangle of every pixel
+    visibility_mesh_t *meshes;      // dynamic array, everything drawn this frame
+    int *triangle_meshes;           // dynamic array, the mesh of every id drawn this frame
+    int x_min, y_min, x_max, y_max; // box around every pixel drawn, empty if min > max
+} visibility_t;
+
+// Sized for the window
+void visibility_init(visibility_t *visibility);
+
+// Start of the frame, no meshes and nothing covered
+void visibility_clear(visibility_t *visibility);
+
+// Registers a mesh for this frame, its triangles are drawn with the returned index. -1 if its
+// triangles would run the frame out of ids, which is reported once
+int visibility_add_mesh(visibility_t *visibility, const triangle_setup_t *triangles,
+                        int num_triangles, const texture_t *texture);
+
+// First pass, depth and id only. Same coverage as draw_textured_triangle
+void visibility_draw_triangle(visibility_t *visibility, int mesh, int triangle);
+
+// Second pass, every covered pixel rebuilds its perspective correct uv from its triangle and is
+// shaded exactly once
+void visibility_resolve(const visibility_t *visibility);
+
+void visibility_free(visibility_t *visibility);
+
+#endif
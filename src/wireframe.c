@@ -0,0 +1,179 @@
+#include "wireframe.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "clip.h"
+#include "display.h"
+
+// Open addressing table of edge indices, keyed by the edge's sorted vertex pair
+static uint32_t edge_hash(int a, int b) {
+    uint64_t key = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+    key *= 0x9E3779B97F4A7C15ull; // fibonacci hashing, top bits are well mixed
+    return (uint32_t)(key >> 32);
+}
+
+static void insert_edge(edge_t **edges, int *table, uint32_t mask, int a, int b, int face) {
+    if (a > b) {
+        int temp = a;
+        a = b;
+        b = temp;
+    }
+
+    uint32_t slot = edge_hash(a, b) & mask;
+    while (table[slot] != -1) {
+        edge_t *edge = &(*edges)[table[slot]];
+        if (edge->a == a && edge->b == b) {
+            // Shared edge, remember the second face so culling can check both sides
+            edge->face_b = face;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    edge_t new_edge = {.a = a, .b = b, .face_a = face, .face_b = -1};
+    table[slot] = array_size(*edges);
+    array_push(*edges, new_edge);
+}
+
+void wireframe_build_edges(edge_t **edges, const face_t *faces) {
+    int num_faces = array_size((void *)faces);
+
+    // At most 3 edges per face, keep the table at most half full
+    uint32_t table_size = 1;
+    while (table_size < (uint32_t)num_faces * 3 * 2)
+        table_size <<= 1;
+    uint32_t mask = table_size - 1;
+
+    int *table = (int *)malloc(table_size * sizeof(int));
+    if (table == NULL) {
+        fprintf(stderr, "Error allocating edge table\n");
+        return;
+    }
+    memset(table, -1, table_size * sizeof(int));
+
+    for (int i = 0; i < num_faces; i++) {
+        insert_edge(edges, table, mask, faces[i].a, faces[i].b, i);
+        insert_edge(edges, table, mask, faces[i].b, faces[i].c, i);
+        insert_edge(edges, table, mask, faces[i].c, faces[i].a, i);
+    }
+    free(table);
+}
+
+void wireframe_init(wireframe_t *wire, int num_vertices) {
+    vec4_soa_hold(&wire->screen_verts, num_vertices);
+    wire->marked_verts = array_hold(wire->marked_verts, num_vertices, sizeof(uint8_t));
+}
+
+static vec2_t project_to_screen(const mat4_t *projection_matrix, vec3_t view_point,
+                                float half_width, float half_height) {
+    vec4_t projected = mat4_mul_vec4_project(projection_matrix, vec3_to_vec4(view_point));
+
+    // Scale up, invert y as models have opposite y axis, and translate to middle of screen
+    vec2_t screen = {
+        projected.x * half_width + half_width,
+        projected.y * -half_height + half_height,
+    };
+    return screen;
+}
+
+static vec3_t lerp_vec3(vec3_t a, vec3_t b, float factor) {
+    return vec3_add(a, vec3_mul(vec3_sub(b, a), factor));
+}
+
+// Clip segment against the near and far planes in view space, returns false if nothing is left
+static bool clip_segment_depth(vec3_t *p0, vec3_t *p1, float z_near, float z_far) {
+    if ((p0->z < z_near && p1->z < z_near) || (p0->z > z_far && p1->z > z_far))
+        return false;
+
+    if (p0->z < z_near)
+        *p0 = lerp_vec3(*p0, *p1, (z_near - p0->z) / (p1->z - p0->z));
+    else if (p1->z < z_near)
+        *p1 = lerp_vec3(*p1, *p0, (z_near - p1->z) / (p0->z - p1->z));
+
+    if (p0->z > z_far)
+        *p0 = lerp_vec3(*p0, *p1, (p0->z - z_far) / (p0->z - p1->z));
+    else if (p1->z > z_far)
+        *p1 = lerp_vec3(*p1, *p0, (p1->z - z_far) / (p1->z - p0->z));
+
+    return true;
+}
+
+static void mark_vertex(wireframe_t *wire, int vertex) {
+    if (wire->marked_verts[vertex])
+        return;
+
+    wire->marked_verts[vertex] = 1;
+    vec2_t point = {wire->screen_verts.x[vertex], wire->screen_verts.y[vertex]};
+    array_push(wire->points, point);
+}
+
+void wireframe_update(wireframe_t *wire, const edge_t *edges, vec3_soa_t view_verts,
+                      int num_vertices, const uint8_t *front_faces,
+                      const mat4_t *projection_matrix, float z_near, float z_far) {
+    array_reset(wire->lines);
+    array_reset(wire->points);
+
+    int window_width, window_height;
+    get_window_size(&window_width, &window_height);
+    float half_width = window_width / 2.f;
+    float half_height = window_height / 2.f;
+
+    // Every vertex is projected exactly once, no matter how many edges share it, the ones behind
+    // the near plane come out as garbage but edges touching them get clipped and re-projected
+    mat4_project_to_screen_soa(projection_matrix, view_verts, wire->screen_verts, half_width,
+                               half_height, num_vertices);
+    memset(wire->marked_verts, 0, num_vertices * sizeof(uint8_t));
+
+    float x_max = window_width - 1;
+    float y_max = window_height - 1;
+
+    int num_edges = array_size((void *)edges);
+    for (int i = 0; i < num_edges; i++) {
+        const edge_t *edge = &edges[i];
+
+        // Edge is only hidden if every face touching it looks away
+        if (front_faces != NULL && !front_faces[edge->face_a] &&
+            (edge->face_b < 0 || !front_faces[edge->face_b]))
+            continue;
+
+        vec3_t p0 = {view_verts.x[edge->a], view_verts.y[edge->a], view_verts.z[edge->a]};
+        vec3_t p1 = {view_verts.x[edge->b], view_verts.y[edge->b], view_verts.z[edge->b]};
+        if (!clip_segment_depth(&p0, &p1, z_near, z_far))
+            continue;
+
+        // Reuse the per-vertex projection unless the endpoint moved while clipping
+        bool a_kept = p0.z == view_verts.z[edge->a];
+        bool b_kept = p1.z == view_verts.z[edge->b];
+        vec2_t s0 = a_kept ? (vec2_t){wire->screen_verts.x[edge->a], wire->screen_verts.y[edge->a]}
+                           : project_to_screen(projection_matrix, p0, half_width, half_height);
+        vec2_t s1 = b_kept ? (vec2_t){wire->screen_verts.x[edge->b], wire->screen_verts.y[edge->b]}
+                           : project_to_screen(projection_matrix, p1, half_width, half_height);
+
+        float x0 = s0.x, y0 = s0.y, x1 = s1.x, y1 = s1.y;
+        if (!clip_line_to_rect(&x0, &y0, &x1, &y1, 0.0f, 0.0f, x_max, y_max))
+            continue;
+
+        line_t line = {roundf(x0), roundf(y0), roundf(x1), roundf(y1)};
+        array_push(wire->lines, line);
+
+        if (should_render_verts()) {
+            if (a_kept)
+                mark_vertex(wire, edge->a);
+            if (b_kept)
+                mark_vertex(wire, edge->b);
+        }
+    }
+}
+
+void wireframe_free(wireframe_t *wire) {
+    vec4_soa_free(&wire->screen_verts);
+    array_free(wire->marked_verts);
+    array_free(wire->lines);
+    array_free(wire->points);
+
+    memset(wire, 0, sizeof(wireframe_t));
+}
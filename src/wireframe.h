@@ -0,0 +1,44 @@
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include <stdint.h>
+
+#include "matrix.h"
+#include "triangle.h"
+#include "vector.h"
+
+// Unique mesh edge, a < b, with the (up to) two faces that share it, face_b is -1 on open edges
+typedef struct {
+    int a, b;
+    int face_a, face_b;
+} edge_t;
+
+// Screen space line, already clipped to the viewport
+typedef struct {
+    int x0, y0, x1, y1;
+} line_t;
+
+// Per-frame state of the wire modes, the edges belong to the model and are shared by every mesh
+// drawing it, this is one per mesh so each can keep its own lines until they are drawn
+typedef struct {
+    vec4_soa_t screen_verts; // one projected position per mesh vertex
+    uint8_t *marked_verts;   // dynamic array, one flag per mesh vertex so markers are drawn once
+    line_t *lines;           // dynamic array of lines to rasterize, reset every frame
+    vec2_t *points;          // dynamic array of vertex markers to rasterize, reset every frame
+} wireframe_t;
+
+// Append the unique edges of faces to the edges dynamic array
+void wireframe_build_edges(edge_t **edges, const face_t *faces);
+
+// Size the per-vertex scratch arrays for meshes of up to num_vertices vertices
+void wireframe_init(wireframe_t *wire, int num_vertices);
+
+// Project each view space vertex once, cull edges whose faces all look away (front_faces is NULL
+// when not culling), clip to near/far and the viewport, outputs into wire->lines and wire->points
+void wireframe_update(wireframe_t *wire, const edge_t *edges, vec3_soa_t view_verts,
+                      int num_vertices, const uint8_t *front_faces,
+                      const mat4_t *projection_matrix, float z_near, float z_far);
+
+void wireframe_free(wireframe_t *wire);
+
+#endif
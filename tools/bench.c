@@ -0,0 +1,559 @@
+// Times the hot kernels on their own, far steadier than a whole frame, so a change of a few percent
+// to one of them shows up. Every kernel is warmed up, then timed over a fixed number of samples of
+// a fixed number of calls, and reported in ns per call
+//   ./renderer_bench [results.csv]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "array.h"
+#include "clip.h"
+#include "display.h"
+#include "matrix.h"
+#include "obj.h"
+#include "sampler.h"
+#include "texture.h"
+#include "triangle.h"
+#include "vector.h"
+#include "vertex_cache.h"
+
+#define M_PI 3.14159265358979323846
+
+#define BENCH_WARMUP_SAMPLES 3
+#define BENCH_SAMPLES 15
+#define BENCH_INPUTS 1024 // inputs cycled through, so one lucky value can't decide a result
+#define BENCH_MAX_NAME 64
+#define BENCH_GRID_CELLS_X 1024 // two faces a cell, a million faces reading 6 MB of positions
+#define BENCH_GRID_CELLS_Y 512
+
+// Runs a kernel calls times on the inputs in data, anything it works out goes into sink
+typedef void (*bench_fn)(void *data, int calls);
+
+typedef struct {
+    char name[BENCH_MAX_NAME];
+    int calls; // per sample, pinned so runs are always comparable
+    double mean, stddev, min, median; // ns per call
+} bench_result_t;
+
+// Kept so the compiler can't drop work nothing reads
+static volatile float sink;
+
+static int compare_doubles(const void *a, const void *b) {
+    double d1 = *(const double *)a, d2 = *(const double *)b;
+    return (d1 > d2) - (d1 < d2);
+}
+
+static float random_float(float min, float max) {
+    return min + (max - min) * ((float)rand() / RAND_MAX);
+}
+
+static bench_result_t bench_run(const char *name, bench_fn fn, void *data, int calls) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double samples[BENCH_SAMPLES];
+
+    for (int i = 0; i < BENCH_WARMUP_SAMPLES; i++) {
+        fn(data, calls);
+    }
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        fn(data, calls);
+        Uint64 end = SDL_GetPerformanceCounter();
+        samples[i] = (end - start) * 1e9 / frequency / calls;
+    }
+
+    bench_result_t result = {.calls = calls};
+    snprintf(result.name, sizeof(result.name), "%s", name);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        result.mean += samples[i];
+    }
+    result.mean /= BENCH_SAMPLES;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        result.stddev += (samples[i] - result.mean) * (samples[i] - result.mean);
+    }
+    result.stddev = sqrt(result.stddev / (BENCH_SAMPLES - 1));
+
+    qsort(samples, BENCH_SAMPLES, sizeof(double), compare_doubles);
+    result.min = samples[0];
+    result.median = samples[BENCH_SAMPLES / 2];
+
+    printf("%-40s %12.1f %10.1f %12.1f %12.1f %10d\n", result.name, result.mean, result.stddev,
+           result.min, result.median, result.calls);
+    return result;
+}
+
+// Kernels
+
+typedef struct {
+    vec2_t a[BENCH_INPUTS], b[BENCH_INPUTS], c[BENCH_INPUTS], p[BENCH_INPUTS];
+} barycentric_data_t;
+
+static void bench_barycentric(void *data, int calls) {
+    const barycentric_data_t *d = data;
+    float total = 0.0f;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        total += barycentric_weights(d->a[n], d->b[n], d->c[n], d->p[n]).x;
+    }
+    sink = total;
+}
+
+typedef struct {
+    texture_t texture, clut8, clut4;
+    sampler_t nearest_pow2, nearest, bilinear, clut8_pow2, clut4_pow2;
+    tex2_t uv[BENCH_INPUTS];
+} texel_data_t;
+
+// Same conversion and fetch as a textured row, kind is a constant in every caller
+static inline void bench_sample(const sampler_t *sampler, sampler_kind_e kind,
+                                const texel_data_t *d, int calls) {
+    uint32_t total = 0;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        int32_t x = sampler_fixed(d->uv[n].u, sampler->scale_u);
+        int32_t y = sampler_fixed(d->uv[n].v, sampler->scale_v);
+        total += sampler_fetch(sampler, kind, x, y).r;
+    }
+    sink = total;
+}
+
+static void bench_sample_nearest_pow2(void *data, int calls) {
+    const texel_data_t *d = data;
+    bench_sample(&d->nearest_pow2, SAMPLER_NEAREST_POW2, d, calls);
+}
+
+static void bench_sample_nearest(void *data, int calls) {
+    const texel_data_t *d = data;
+    bench_sample(&d->nearest, SAMPLER_NEAREST, d, calls);
+}
+
+static void bench_sample_bilinear(void *data, int calls) {
+    const texel_data_t *d = data;
+    bench_sample(&d->bilinear, SAMPLER_BILINEAR, d, calls);
+}
+
+static void bench_sample_clut8_pow2(void *data, int calls) {
+    const texel_data_t *d = data;
+    bench_sample(&d->clut8_pow2, SAMPLER_NEAREST_POW2_CLUT8, d, calls);
+}
+
+static void bench_sample_clut4_pow2(void *data, int calls) {
+    const texel_data_t *d = data;
+    bench_sample(&d->clut4_pow2, SAMPLER_NEAREST_POW2_CLUT4, d, calls);
+}
+
+// Palettized copy of an RGBA32 texture
+static texture_t bench_palettize(const texture_t *texture, texture_format_e format) {
+    texture_t copy = *texture;
+    size_t bytes = (size_t)texture->width * texture->height * sizeof(color_t);
+    copy.pixels = malloc(bytes);
+    memcpy(copy.pixels, texture->pixels, bytes);
+    texture_palettize(&copy, format);
+    return copy;
+}
+
+typedef struct {
+    int x[BENCH_INPUTS], y[BENCH_INPUTS];
+    float w[BENCH_INPUTS];
+} w_pixel_data_t;
+
+// A depth tested pixel, the innermost step of every filled and textured mode
+static void bench_w_pixel(void *data, int calls) {
+    const w_pixel_data_t *d = data;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        if (d->w[n] > w_buffer_at(d->x[n], d->y[n])) {
+            draw_pixel(d->x[n], d->y[n], PURPLE);
+            update_w_buffer(d->x[n], d->y[n], d->w[n]);
+        }
+    }
+    // Otherwise every test after the first pass fails
+    clear_w_buffer();
+}
+
+typedef struct {
+    const plane_t *planes;
+    polygon_t polygon;
+} clip_data_t;
+
+static void bench_clip(void *data, int calls) {
+    const clip_data_t *d = data;
+    int total = 0;
+    for (int i = 0; i < calls; i++) {
+        polygon_t polygon = d->polygon;
+        clip_polygon_to_planes(d->planes, &polygon);
+        total += polygon.num_vertices;
+    }
+    sink = total;
+}
+
+static void bench_polygon_to_tris(void *data, int calls) {
+    const polygon_t *polygon = data;
+    triangle_t triangles[MAX_NUM_POLY_TRIS];
+    int total = 0;
+    for (int i = 0; i < calls; i++) {
+        total += polygon_to_tris(polygon, triangles);
+    }
+    sink = total + triangles[0].points[0].x;
+}
+
+typedef struct {
+    mat4_t matrices[BENCH_INPUTS];
+    vec4_t vectors[BENCH_INPUTS];
+} matrix_data_t;
+
+static void bench_mat4_mul_vec4(void *data, int calls) {
+    const matrix_data_t *d = data;
+    float total = 0.0f;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        total += mat4_mul_vec4(&d->matrices[n], d->vectors[n]).w;
+    }
+    sink = total;
+}
+
+static void bench_mat4_mul_mat4(void *data, int calls) {
+    const matrix_data_t *d = data;
+    float total = 0.0f;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        mat4_t m = mat4_mul_mat4(&d->matrices[n], &d->matrices[(n + 1) & (BENCH_INPUTS - 1)]);
+        total += m.m[3][3];
+    }
+    sink = total;
+}
+
+typedef struct {
+    int x0[BENCH_INPUTS], y0[BENCH_INPUTS], x1[BENCH_INPUTS], y1[BENCH_INPUTS];
+} line_data_t;
+
+static void bench_draw_line(void *data, int calls) {
+    const line_data_t *d = data;
+    for (int i = 0; i < calls; i++) {
+        int n = i & (BENCH_INPUTS - 1);
+        draw_line(d->x0[n], d->y0[n], d->x1[n], d->y1[n], GREEN);
+    }
+}
+
+static void bench_clear_color_buffer(void *data, int calls) {
+    (void)data;
+    for (int i = 0; i < calls; i++) {
+        clear_color_buffer(BLACK);
+    }
+}
+
+typedef struct {
+    triangle_setup_t triangles[BENCH_INPUTS];
+    const texture_t *texture;
+} raster_data_t;
+
+static void bench_textured_triangle(void *data, int calls) {
+    const raster_data_t *d = data;
+    for (int i = 0; i < calls; i++) {
+        draw_textured_triangle(&d->triangles[i & (BENCH_INPUTS - 1)], d->texture);
+    }
+    clear_w_buffer();
+}
+
+static void bench_load_obj(void *data, int calls) {
+    const char *file_name = data;
+    int total = 0;
+    for (int i = 0; i < calls; i++) {
+        vec3_t *vertices = NULL;
+        face_t *faces = NULL;
+        load_obj_file_data(file_name, &vertices, &faces);
+        total += array_size(faces);
+        array_free(vertices);
+        array_free(faces);
+    }
+    sink = total;
+}
+
+// Faces of a grid over its vertices, first both in a random order, as an exporter that doesn't
+// care might write them, then reordered for the vertex cache
+typedef struct {
+    vec3_t *vertices;     // dynamic array
+    face_t *faces;        // dynamic array
+    vec3_soa_t positions; // the vertices as the geometry stage reads them
+} fetch_data_t;
+
+// Every corner of every face gathered in order, like the geometry stage after the transform
+static void bench_face_fetch(void *data, int calls) {
+    const fetch_data_t *d = data;
+    int num_faces = array_size(d->faces);
+    float total = 0.0f;
+    for (int i = 0; i < calls; i++) {
+        const face_t *face = &d->faces[i % num_faces];
+        int indices[3] = {face->a, face->b, face->c};
+        for (int j = 0; j < 3; j++) {
+            total += d->positions.x[indices[j]] + d->positions.y[indices[j]] +
+                     d->positions.z[indices[j]];
+        }
+    }
+    sink = total;
+}
+
+// Inputs
+
+static polygon_t make_polygon(vec3_t a, vec3_t b, vec3_t c) {
+    return (polygon_t){
+        .vertices = {a, b, c},
+        .tex_coords = {{0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 1.0f}},
+        .num_vertices = 3,
+    };
+}
+
+static mat4_t random_matrix(void) {
+    mat4_t m;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m.m[r][c] = random_float(-1.0f, 1.0f);
+        }
+    }
+    return m;
+}
+
+// Somewhere between a few and a few thousand pixels, like most of a real frame
+static triangle_setup_t random_setup(int width, int height) {
+    triangle_t triangle = {0};
+    float x = random_float(0.0f, width - 64.0f), y = random_float(0.0f, height - 64.0f);
+    float size = random_float(2.0f, 64.0f);
+    for (int i = 0; i < 3; i++) {
+        triangle.points[i] = (vec4_t){x + random_float(0.0f, size), y + random_float(0.0f, size),
+                                      0.0f, random_float(1.0f, 10.0f)};
+        triangle.tex_coords[i] = (tex2_t){random_float(0.0f, 1.0f), random_float(0.0f, 1.0f)};
+    }
+    sort_triangle_by_y(&triangle);
+
+    triangle_setup_t setup = {0};
+    if (!triangle_setup_init(&setup, &triangle))
+        return random_setup(width, height);
+    return setup;
+}
+
+static void shuffle_ints(int *values, int count) {
+    for (int i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int swap = values[i];
+        values[i] = values[j];
+        values[j] = swap;
+    }
+}
+
+static void make_shuffled_grid(fetch_data_t *d) {
+    int columns = BENCH_GRID_CELLS_X + 1;
+    int num_vertices = columns * (BENCH_GRID_CELLS_Y + 1);
+    int *order = malloc(sizeof(int) * num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        order[i] = i;
+    }
+    shuffle_ints(order, num_vertices);
+
+    d->vertices = array_hold(d->vertices, num_vertices, sizeof(vec3_t));
+    for (int i = 0; i < num_vertices; i++) {
+        d->vertices[order[i]] = (vec3_t){(float)(i % columns), (float)(i / columns), 0.0f};
+    }
+
+    int num_faces = BENCH_GRID_CELLS_X * BENCH_GRID_CELLS_Y * 2;
+    int *face_order = malloc(sizeof(int) * num_faces);
+    for (int i = 0; i < num_faces; i++) {
+        face_order[i] = i;
+    }
+    shuffle_ints(face_order, num_faces);
+
+    d->faces = array_hold(d->faces, num_faces, sizeof(face_t));
+    for (int i = 0; i < num_faces; i++) {
+        int cell = i / 2;
+        int corner = cell / BENCH_GRID_CELLS_X * columns + cell % BENCH_GRID_CELLS_X;
+        int a = corner, b = corner + 1, c = corner + columns + 1, e = corner + columns;
+        face_t face = i % 2 == 0 ? (face_t){.a = order[a], .b = order[b], .c = order[c]}
+                                 : (face_t){.a = order[a], .b = order[c], .c = order[e]};
+        d->faces[face_order[i]] = face;
+    }
+
+    free(order);
+    free(face_order);
+}
+
+static void fetch_data_positions(fetch_data_t *d) {
+    int num_vertices = array_size(d->vertices);
+    vec3_soa_hold(&d->positions, num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        d->positions.x[i] = d->vertices[i].x;
+        d->positions.y[i] = d->vertices[i].y;
+        d->positions.z[i] = d->vertices[i].z;
+    }
+}
+
+static const char *const bench_assets[] = {
+    "./assets/cube.obj", "./assets/sphere.obj", "./assets/crab.obj", "./assets/drone.obj",
+    "./assets/efa.obj",  "./assets/f117.obj",   "./assets/f22.obj",
+};
+#define NUM_BENCH_ASSETS (int)(sizeof(bench_assets) / sizeof(bench_assets[0]))
+
+int main(int argc, char *args[]) {
+    if (!window_init())
+        return 1;
+
+    int width, height;
+    get_window_size(&width, &height);
+    srand(1); // same inputs every run
+    begin_color_buffer();
+
+    bench_result_t *results = NULL; // dynamic array
+    printf("%-40s %12s %10s %12s %12s %10s\n", "kernel", "mean ns", "stddev", "min ns",
+           "median ns", "calls");
+
+    barycentric_data_t *barycentric = malloc(sizeof(barycentric_data_t));
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        barycentric->a[i] = (vec2_t){random_float(0, 100), random_float(0, 100)};
+        barycentric->b[i] = (vec2_t){random_float(0, 100), random_float(0, 100)};
+        barycentric->c[i] = (vec2_t){random_float(0, 100), random_float(0, 100)};
+        barycentric->p[i] = (vec2_t){random_float(0, 100), random_float(0, 100)};
+    }
+    array_push(results, bench_run("barycentric_weights", bench_barycentric, barycentric, 1 << 20));
+    free(barycentric);
+
+    // Synthetic so it runs without any asset, big enough to miss in the first level of cache
+    texel_data_t *texel = malloc(sizeof(texel_data_t));
+    texel->texture = (texture_t){.width = 512, .height = 512, .pow2 = true};
+    texel->texture.pixels = malloc(512 * 512 * sizeof(color_t));
+    for (int i = 0; i < 512 * 512; i++) {
+        texel->texture.pixels[i] = (color_t)(0xFF000000u | ((uint32_t)i * 2654435761u >> 8));
+    }
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        texel->uv[i] = (tex2_t){random_float(0.0f, 1.0f), random_float(0.0f, 1.0f)};
+    }
+    sampler_init(&texel->nearest_pow2, &texel->texture, false);
+    sampler_init(&texel->bilinear, &texel->texture, true);
+    // The general path, as a texture of any other size or mode would take
+    texel->nearest = texel->nearest_pow2;
+    texel->nearest.kind = SAMPLER_NEAREST;
+    array_push(results,
+               bench_run("sample_nearest_pow2", bench_sample_nearest_pow2, texel, 1 << 20));
+    array_push(results, bench_run("sample_nearest", bench_sample_nearest, texel, 1 << 20));
+    array_push(results, bench_run("sample_bilinear", bench_sample_bilinear, texel, 1 << 20));
+
+    // The same texels at a quarter and an eighth of the size
+    texel->clut8 = bench_palettize(&texel->texture, TEXTURE_CLUT8);
+    texel->clut4 = bench_palettize(&texel->texture, TEXTURE_CLUT4);
+    sampler_init(&texel->clut8_pow2, &texel->clut8, false);
+    sampler_init(&texel->clut4_pow2, &texel->clut4, false);
+    array_push(results,
+               bench_run("sample_clut8_pow2", bench_sample_clut8_pow2, texel, 1 << 20));
+    array_push(results,
+               bench_run("sample_clut4_pow2", bench_sample_clut4_pow2, texel, 1 << 20));
+
+    w_pixel_data_t *w_pixel = malloc(sizeof(w_pixel_data_t));
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        w_pixel->x[i] = rand() % width;
+        w_pixel->y[i] = rand() % height;
+        w_pixel->w[i] = random_float(0.1f, 1.0f);
+    }
+    array_push(results, bench_run("w_tested_pixel", bench_w_pixel, w_pixel, 1 << 20));
+    free(w_pixel);
+
+    // Same view space frustum as the scene, the camera looks down +z
+    plane_t planes[NUM_PLANES];
+    float fov_y = M_PI / 2.0f;
+    float fov_x = 2.0f * atanf(tanf(fov_y / 2.0f) * width / height);
+    frustum_planes_init(planes, fov_x, fov_y, 1.0f, 50.0f);
+
+    clip_data_t clip = {.planes = planes};
+    clip.polygon = make_polygon((vec3_t){-1, -1, 5}, (vec3_t){0, 1, 5}, (vec3_t){1, -1, 5});
+    array_push(results, bench_run("clip_polygon_to_planes inside", bench_clip, &clip, 1 << 18));
+    // Through the near plane and out one side, the worst case clips against two planes
+    clip.polygon = make_polygon((vec3_t){-1, -1, -1}, (vec3_t){0, 1, 5}, (vec3_t){20, -1, 5});
+    array_push(results, bench_run("clip_polygon_to_planes partial", bench_clip, &clip, 1 << 18));
+    clip.polygon = make_polygon((vec3_t){-1, -1, -5}, (vec3_t){0, 1, -5}, (vec3_t){1, -1, -5});
+    array_push(results, bench_run("clip_polygon_to_planes outside", bench_clip, &clip, 1 << 18));
+
+    polygon_t clipped = make_polygon((vec3_t){-1, -1, -1}, (vec3_t){0, 1, 5}, (vec3_t){20, -1, 5});
+    clip_polygon_to_planes(planes, &clipped);
+    array_push(results, bench_run("polygon_to_tris", bench_polygon_to_tris, &clipped, 1 << 20));
+
+    matrix_data_t *matrices = malloc(sizeof(matrix_data_t));
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        matrices->matrices[i] = random_matrix();
+        matrices->vectors[i] = (vec4_t){random_float(-1, 1), random_float(-1, 1),
+                                        random_float(-1, 1), 1.0f};
+    }
+    array_push(results, bench_run("mat4_mul_vec4", bench_mat4_mul_vec4, matrices, 1 << 20));
+    array_push(results, bench_run("mat4_mul_mat4", bench_mat4_mul_mat4, matrices, 1 << 20));
+    free(matrices);
+
+    // Some start or end off screen, so clipping is part of it like in the wire modes
+    line_data_t *lines = malloc(sizeof(line_data_t));
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        lines->x0[i] = rand() % (width + 200) - 100;
+        lines->y0[i] = rand() % (height + 200) - 100;
+        lines->x1[i] = rand() % (width + 200) - 100;
+        lines->y1[i] = rand() % (height + 200) - 100;
+    }
+    array_push(results, bench_run("draw_line", bench_draw_line, lines, 1 << 14));
+    free(lines);
+
+    array_push(results, bench_run("clear_color_buffer", bench_clear_color_buffer, NULL, 64));
+
+    raster_data_t *raster = malloc(sizeof(raster_data_t));
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        raster->triangles[i] = random_setup(width, height);
+    }
+    raster->texture = &texel->texture;
+    array_push(results,
+               bench_run("draw_textured_triangle", bench_textured_triangle, raster, 1 << 14));
+    free(raster);
+    free(texel->texture.pixels);
+    texture_free(&texel->clut8);
+    texture_free(&texel->clut4);
+    free(texel);
+
+    // One call per face, every face once
+    fetch_data_t *fetch = calloc(1, sizeof(fetch_data_t));
+    make_shuffled_grid(fetch);
+    int num_grid_faces = array_size(fetch->faces);
+    fetch_data_positions(fetch);
+    array_push(results,
+               bench_run("face_vertex_fetch shuffled", bench_face_fetch, fetch, num_grid_faces));
+    vertex_cache_optimize(fetch->vertices, fetch->faces);
+    fetch_data_positions(fetch);
+    array_push(results,
+               bench_run("face_vertex_fetch reordered", bench_face_fetch, fetch, num_grid_faces));
+    array_free(fetch->vertices);
+    array_free(fetch->faces);
+    vec3_soa_free(&fetch->positions);
+    free(fetch);
+
+    // One call loads the whole file, so few of them
+    for (int i = 0; i < NUM_BENCH_ASSETS; i++) {
+        char name[BENCH_MAX_NAME];
+        snprintf(name, sizeof(name), "load_obj_file_data %s", bench_assets[i]);
+        array_push(results, bench_run(name, bench_load_obj, (void *)bench_assets[i], 4));
+    }
+
+    render_color_buffer();
+
+    if (argc > 1) {
+        FILE *file = fopen(args[1], "w");
+        if (file == NULL) {
+            fprintf(stderr, "Error opening results file %s\n", args[1]);
+        } else {
+            fprintf(file, "kernel,mean_ns,stddev_ns,min_ns,median_ns,calls,samples\n");
+            int num_results = array_size(results);
+            for (int i = 0; i < num_results; i++) {
+                const bench_result_t *r = &results[i];
+                fprintf(file, "%s,%.3f,%.3f,%.3f,%.3f,%d,%d\n", r->name, r->mean, r->stddev,
+                        r->min, r->median, r->calls, BENCH_SAMPLES);
+            }
+            fclose(file);
+        }
+    }
+
+    array_free(results);
+    window_free();
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Draws a frame written by capture_write over and over and times only the rasterizer, so changes
+// to it can be compared on exactly the same triangles
+//   ./replay ./capture.bin [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "array.h"
+#include "capture.h"
+#include "display.h"
+#include "triangle.h"
+#include "visibility.h"
+
+#define REPLAY_DEFAULT_ITERATIONS 100
+
+static int compare_times(const void *a, const void *b) {
+    double t1 = *(const double *)a, t2 = *(const double *)b;
+    return (t1 > t2) - (t1 < t2);
+}
+
+// Settings only switch, so they are flipped until they match the ones captured
+static void apply_settings(const capture_t *capture) {
+    set_render_mode(capture->render_mode);
+    if (texture_span_length() != capture->span_length)
+        switch_texture_span_length();
+    if (should_filter_bilinear() != capture->bilinear_filter)
+        switch_texture_filter();
+}
+
+// Same as render in main, minus the background and the wire modes
+static void draw_capture(const capture_t *capture, visibility_t *visibility) {
+    bool deferred = should_render_visibility();
+    if (deferred)
+        visibility_clear(visibility);
+
+    int num_meshes = array_size(capture->meshes);
+    for (int m = 0; m < num_meshes; m++) {
+        const capture_mesh_t *mesh = &capture->meshes[m];
+        const texture_t *texture = mesh->texture >= 0 ? &capture->textures[mesh->texture] : NULL;
+        int num_triangles = array_size(mesh->triangles);
+
+        if (deferred) {
+            int id = visibility_add_mesh(visibility, mesh->triangles, num_triangles, texture);
+            for (int i = 0; i < num_triangles; i++) {
+                visibility_draw_triangle(visibility, id, i);
+            }
+            continue;
+        }
+
+        draw_mesh_triangles(mesh->triangles, num_triangles, texture);
+    }
+
+    if (deferred)
+        visibility_resolve(visibility);
+}
+
+int main(int argc, char *args[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [iterations]\n", args[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(args[2]) : REPLAY_DEFAULT_ITERATIONS;
+    iterations = iterations < 1 ? 1 : iterations;
+
+    capture_t capture = {0};
+    if (!capture_read(&capture, args[1]))
+        return 1;
+
+    if (!window_init()) {
+        capture_free(&capture);
+        return 1;
+    }
+
+    // Triangles outside a smaller window are clipped, so it still runs, just not on the same work
+    int width, height;
+    get_window_size(&width, &height);
+    if (width != capture.width || height != capture.height) {
+        fprintf(stderr, "Warning: captured at %dx%d, replaying at %dx%d\n", capture.width,
+                capture.height, width, height);
+    }
+
+    visibility_t visibility = {0};
+    visibility_init(&visibility);
+    apply_settings(&capture);
+
+    int num_triangles = 0;
+    int num_meshes = array_size(capture.meshes);
+    for (int m = 0; m < num_meshes; m++) {
+        num_triangles += array_size(capture.meshes[m].triangles);
+    }
+
+    double *times = NULL; // dynamic array, milliseconds
+    times = array_hold(times, iterations, sizeof(double));
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    for (int i = 0; i < iterations; i++) {
+        begin_color_buffer();
+        clear_color_buffer(BLACK);
+        clear_w_buffer();
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        draw_capture(&capture, &visibility);
+        Uint64 end = SDL_GetPerformanceCounter();
+        times[i] = (end - start) * 1000.0 / frequency;
+
+        render_color_buffer();
+    }
+
+    double total = 0.0;
+    for (int i = 0; i < iterations; i++) {
+        total += times[i];
+    }
+    qsort(times, iterations, sizeof(double), compare_times);
+
+    printf("%d meshes, %d triangles, %d iterations\n", num_meshes, num_triangles, iterations);
+    printf("min %.3f ms  median %.3f ms  mean %.3f ms  max %.3f ms\n", times[0],
+           times[iterations / 2], total / iterations, times[iterations - 1]);
+
+    array_free(times);
+    visibility_free(&visibility);
+    capture_free(&capture);
+    window_free();
+
+    return 0;
+}